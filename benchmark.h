@@ -0,0 +1,160 @@
+#pragma once
+
+#include "timer.h"
+#include <cmath>
+#include <functional>
+
+/**
+ * @brief Settings for a BenchmarkHarness case.
+ */
+struct BenchmarkOptions
+{
+    int warmups = 1;                // untimed runs before measuring
+    int minRepeats = 5;             // always time at least this many runs
+    int maxRepeats = 100;           // never time more than this many runs
+    double settleTolerance = 0.01;  // stop once the standard error of the mean is below this fraction of the mean; 0 always runs maxRepeats
+    double elements = 0;            // elements processed per run, for elements/s (0 to skip)
+    double bytes = 0;               // bytes touched per run, for GB/s (0 to skip)
+};
+
+/**
+ * @brief Summary statistics of all timed runs of one case, in the harness' Tdur units.
+ */
+struct BenchmarkResult
+{
+    std::string label;
+    std::string unit;
+    std::vector<double> samples; // one duration per timed run, in order
+    double min = 0;
+    double median = 0;
+    double p99 = 0;
+    double mean = 0;
+    double stddev = 0;
+    double elementsPerSecond = 0;
+    double gigabytesPerSecond = 0;
+
+    void print() const {
+        printf("%s : %zu runs, min %f %s, median %f %s, p99 %f %s, stddev %f %s",
+               label.c_str(), samples.size(),
+               min, unit.c_str(), median, unit.c_str(),
+               p99, unit.c_str(), stddev, unit.c_str());
+        if (elementsPerSecond > 0)
+            printf(", %.3f Melem/s", elementsPerSecond / 1e6);
+        if (gigabytesPerSecond > 0)
+            printf(", %.3f GB/s", gigabytesPerSecond);
+        printf("\n");
+    }
+
+    /**
+     * @brief Returns one record per timed run, tagged with its repeat index, for writeTimerRecords().
+     */
+    std::vector<TimerRecord> records() const {
+        std::vector<TimerRecord> r;
+        for (size_t i = 0; i < samples.size(); ++i)
+            r.push_back(TimerRecord{label, samples[i], unit, 0, i});
+        return r;
+    }
+};
+
+/**
+ * @brief Repeatedly times a callable with a HighResolutionTimer and summarises the runs.
+ *
+ * Example:
+ *   BenchmarkHarness<std::chrono::microseconds> bench;
+ *   BenchmarkOptions opts;
+ *   opts.bytes = 3 * len * sizeof(float);
+ *   bench.run("naiveAdd", [&](){ naiveAdd(x, y, z); }, opts).print();
+ */
+template <typename Tdur = std::chrono::milliseconds, typename Clock = std::chrono::high_resolution_clock>
+class BenchmarkHarness
+{
+public:
+    /**
+     * @brief Runs the warmups, then times fn() until the runs settle or maxRepeats is hit.
+     *
+     * @param label Name of the case, used when printing.
+     * @param fn Callable containing the work for a single run.
+     * @param opts Repeat and throughput settings.
+     */
+    BenchmarkResult run(const std::string& label, const std::function<void()>& fn,
+                        const BenchmarkOptions& opts = BenchmarkOptions())
+    {
+        for (int i = 0; i < opts.warmups; ++i)
+            fn();
+
+        BenchmarkResult result;
+        result.label = label;
+        result.unit = duration_unit_string<Tdur>();
+        result.samples.reserve(opts.maxRepeats);
+
+        HighResolutionTimer<Tdur, Clock> timer;
+        for (int i = 0; i < opts.maxRepeats; ++i)
+        {
+            timer.start("", true);
+            fn();
+            timer.event("", true);
+            const auto& t = timer.measurements();
+            result.samples.push_back(toUnits(t.back().first - t.front().first));
+
+            if (i + 1 >= opts.minRepeats && settled(result.samples, opts.settleTolerance))
+                break;
+        }
+
+        summarise(result, opts);
+        return result;
+    }
+
+private:
+    template <typename Tdiff>
+    static double toUnits(const Tdiff& d){
+        return std::chrono::duration<double, typename Tdur::period>(d).count();
+    }
+
+    static double seconds(double units){
+        return units * Tdur::period::num / Tdur::period::den;
+    }
+
+    static void meanStddev(const std::vector<double>& x, double& mean, double& stddev){
+        mean = 0;
+        for (double v : x)
+            mean += v;
+        mean /= x.size();
+        double ss = 0;
+        for (double v : x)
+            ss += (v - mean) * (v - mean);
+        stddev = x.size() > 1 ? std::sqrt(ss / (x.size() - 1)) : 0;
+    }
+
+    static bool settled(const std::vector<double>& x, double tolerance){
+        if (tolerance <= 0 || x.size() < 2)
+            return false;
+        double mean, stddev;
+        meanStddev(x, mean, stddev);
+        return mean > 0 && stddev / std::sqrt((double)x.size()) < tolerance * mean;
+    }
+
+    // Nearest-rank percentile of sorted data
+    static double percentile(const std::vector<double>& sorted, double p){
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted.at(rank > 0 ? rank - 1 : 0);
+    }
+
+    static void summarise(BenchmarkResult& result, const BenchmarkOptions& opts){
+        if (result.samples.empty())
+            return;
+        std::vector<double> sorted(result.samples);
+        std::sort(sorted.begin(), sorted.end());
+        result.min = sorted.front();
+        size_t n = sorted.size();
+        result.median = n % 2 ? sorted[n/2] : 0.5 * (sorted[n/2 - 1] + sorted[n/2]);
+        result.p99 = percentile(sorted, 99.0);
+        meanStddev(sorted, result.mean, result.stddev);
+
+        // Throughput is quoted at the median, which is less sensitive to outliers than the mean
+        double medianSeconds = seconds(result.median);
+        if (medianSeconds > 0){
+            result.elementsPerSecond = opts.elements / medianSeconds;
+            result.gigabytesPerSecond = opts.bytes / medianSeconds / 1e9;
+        }
+    }
+};
@@ -122,7 +122,7 @@ std::complex<T> iterToneUnrollN(T startPhase, T rFreq, size_t length)
     return tones[UNROLL-1];
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     double startPhase = 0.0;
     double rFreq = 1e-9;
@@ -137,71 +137,64 @@ int main()
 
     constexpr size_t UNROLL = 4;
 
-    {
-        HighResolutionTimer timer;
-
-        std::complex<double> tone;
-        for (int i = 0; i < repeats; ++i)
-        {
-            tone = iterToneUnroll4<double>(startPhase, rFreq, length);
-            // tone = iterToneUnrollN<double, UNROLL>(startPhase, rFreq, length);
+    // One event per repeat, so each call is its own section; recording an event doesn't allocate,
+    // so the instrumentation stays out of the kernels' timings
+    RingEventTimer<> timer(4 * (repeats + 1));
+    timer.start("iterToneUnroll4<double> begin");
 
-        }
-        printf("Tone (%zd unrolls) after %zd steps is (%f, %f)\n", UNROLL, length, tone.real(), tone.imag());
+    std::complex<double> tone;
+    for (int i = 0; i < repeats; ++i)
+    {
+        tone = iterToneUnroll4<double>(startPhase, rFreq, length);
+        // tone = iterToneUnrollN<double, UNROLL>(startPhase, rFreq, length);
+        timer.event("iterToneUnroll4<double>");
     }
-    
-
-    
 
+    timer.event("iterToneUnroll4<float> begin");
+    std::complex<float> toneFloat;
+    for (int i = 0; i < repeats; ++i)
     {
-        HighResolutionTimer timer;
-        std::complex<float> toneFloat;
-        for (int i = 0; i < repeats; ++i)
-        {
-            toneFloat = iterToneUnroll4<float>(
-                static_cast<float>(startPhase), 
-                static_cast<float>(rFreq), 
-                length);
-
-            // toneFloat = iterToneUnrollN<float, UNROLL>(
-            //     static_cast<float>(startPhase), 
-            //     static_cast<float>(rFreq), 
-            //     length);
-        }
-        printf("ToneFloat (%zd unrolls) after %zd steps is (%f, %f)\n", UNROLL, length, toneFloat.real(), toneFloat.imag());
+        toneFloat = iterToneUnroll4<float>(
+            static_cast<float>(startPhase), 
+            static_cast<float>(rFreq), 
+            length);
+
+        // toneFloat = iterToneUnrollN<float, UNROLL>(
+        //     static_cast<float>(startPhase), 
+        //     static_cast<float>(rFreq), 
+        //     length);
+        timer.event("iterToneUnroll4<float>");
     }
-    
-
 
     ippe::vector<Ipp64fc> iTone((int)length);
 
     // IPP first call has some initial loading time
+    timer.event("ippsTone (Fast) begin");
+    for (int i = 0; i < repeats; ++i)
     {
-        HighResolutionTimer timer;
-        for (int i = 0; i < repeats; ++i)
-        {
-            double phase = startPhase;
-            ippe::generator::Tone(iTone.data(), (int)iTone.size(), 1.0, rFreq, &phase, IppHintAlgorithm::ippAlgHintFast);
-            
-        }
-        printf("ippsTone (Fast) last value is (%f, %f)\n", iTone.back().re, iTone.back().im);
+        double phase = startPhase;
+        ippe::generator::Tone(iTone.data(), (int)iTone.size(), 1.0, rFreq, &phase, IppHintAlgorithm::ippAlgHintFast);
+        timer.event("ippsTone (Fast)");
     }
+    Ipp64fc lastFast = iTone.back();
 
+    timer.event("ippsTone (Accurate) begin");
+    for (int i = 0; i < repeats; ++i)
     {
-        HighResolutionTimer timer;
-        for (int i = 0; i < repeats; ++i)
-        {
-            double phase = startPhase;
-            ippe::generator::Tone(iTone.data(), (int)iTone.size(), 1.0, rFreq, &phase, IppHintAlgorithm::ippAlgHintAccurate);
-            
-        }
-        printf("ippsTone (Accurate) last value is (%f, %f)\n", iTone.back().re, iTone.back().im);
+        double phase = startPhase;
+        ippe::generator::Tone(iTone.data(), (int)iTone.size(), 1.0, rFreq, &phase, IppHintAlgorithm::ippAlgHintAccurate);
+        timer.event("ippsTone (Accurate)");
     }
-    
-    
-    
+    timer.report();
 
+    printf("Tone (%zd unrolls) after %zd steps is (%f, %f)\n", UNROLL, length, tone.real(), tone.imag());
+    printf("ToneFloat (%zd unrolls) after %zd steps is (%f, %f)\n", UNROLL, length, toneFloat.real(), toneFloat.imag());
+    printf("ippsTone (Fast) last value is (%f, %f)\n", lastFast.re, lastFast.im);
+    printf("ippsTone (Accurate) last value is (%f, %f)\n", iTone.back().re, iTone.back().im);
 
+    // optionally save the sections (.csv or .json) so they can be compared with timer_compare
+    if (argc > 1 && !writeTimerRecords(argv[1], timer.sections()))
+        printf("Failed to write %s\n", argv[1]);
 
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,5 @@
 #include <iostream>
-#include "timer.h"
+#include "benchmark.h"
 #include <vector>
 
 template <typename T>
@@ -33,7 +33,7 @@ void explicitUnrollAdd(const std::vector<T> &x ,const std::vector<T> &y, std::ve
 }
 
          
-int main()
+int main(int argc, char *argv[])
 {
     size_t len = 1000000;
     int numLoops = 10;
@@ -42,25 +42,29 @@ int main()
     std::vector<float> y(len);
     std::vector<float> z(len);
 
-    {
-        HighResolutionTimer timer;
-        for (int i = 0; i < numLoops; ++i)
-            naiveAdd(x,y,z);
-    }
+    BenchmarkHarness<> bench;
+    BenchmarkOptions opts;
+    opts.maxRepeats = numLoops * 5;
+    opts.elements = (double)len;
+    opts.bytes = 3.0 * len * sizeof(float); // 2 reads + 1 write
 
-    {
-        HighResolutionTimer timer;
-        for (int i = 0; i < numLoops; ++i)
-            naiveAddPointers(x.data(), y.data(), z.data(), x.size()); 
-    }
+    std::vector<BenchmarkResult> results;
+    results.push_back(bench.run("naiveAdd", [&](){ naiveAdd(x,y,z); }, opts));
 
+    results.push_back(bench.run("naiveAddPointers", [&](){ naiveAddPointers(x.data(), y.data(), z.data(), x.size()); }, opts));
 
-    {
-        HighResolutionTimer timer;
-        for (int i = 0; i < numLoops; ++i)
-            explicitUnrollAdd(x,y,z);
+    results.push_back(bench.run("explicitUnrollAdd", [&](){ explicitUnrollAdd(x,y,z); }, opts));
+
+    std::vector<TimerRecord> records;
+    for (const auto& result : results){
+        result.print();
+        std::vector<TimerRecord> r = result.records();
+        records.insert(records.end(), r.begin(), r.end());
     }
 
+    // optionally save the runs (.csv or .json) so they can be compared with timer_compare
+    if (argc > 1 && !writeTimerRecords(argv[1], records))
+        printf("Failed to write %s\n", argv[1]);
 
     return 0;
 }
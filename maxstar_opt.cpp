@@ -1,6 +1,6 @@
 #include "ipp_ext.h"
 #include <cmath>
-#include "timer.h"
+#include "benchmark.h"
 
 
 /* Exact calculation of the log-MAP algorithm */
@@ -126,49 +126,36 @@ int main()
 
     int loops = 10;
 
+    BenchmarkHarness<> bench;
+    BenchmarkOptions opts;
+    opts.maxRepeats = loops;
+    opts.elements = (double)length;
+    opts.bytes = 3.0 * length * sizeof(Ipp32f); // 2 reads + 1 write
 
     // Time optimized call
-    printf("Optimized:\n");
-    {
-        HighResolutionTimer timer;
-        for (int l = 0; l < loops; l++)
+    bench.run("Optimized", [&](){
+        for (int i = 0; i < x.size(); i++)
         {
-            for (int i = 0; i < x.size(); i++)
-            {
-                z2[i] = opt_maxstar(x[i], y[i]);
-            } 
-        }
-    }
+            z2[i] = opt_maxstar(x[i], y[i]);
+        } 
+    }, opts).print();
 
     // Time Original full log map
-    printf("Original maxstar4 (full log map):\n");
-    {
-        HighResolutionTimer timer;
-        for (int l = 0; l < loops; l++)
+    bench.run("Original maxstar4 (full log map)", [&](){
+        for (int i = 0; i < x.size(); i++)
         {
-            for (int i = 0; i < x.size(); i++)
-            {
-                z1[i] = max_star4(x[i], y[i]);
-            }
+            z1[i] = max_star4(x[i], y[i]);
         }
-    }
-
-
-
+    }, opts).print();
 
     // Time original call
-    printf("Original maxstar0 (linear log map approx):\n");
-    {
-        HighResolutionTimer timer;
-        for (int l = 0; l < loops; l++)
+    bench.run("Original maxstar0 (linear log map approx)", [&](){
+        for (int i = 0; i < x.size(); i++)
         {
-            for (int i = 0; i < x.size(); i++)
-            {
-                z1[i] = max_star0(x[i], y[i]);
-            }
- 
+            z1[i] = max_star0(x[i], y[i]);
         }
-    }
+    }, opts).print();
+
     // Check all equal
     for (int i = 0; i < z1.size(); i++)
     {
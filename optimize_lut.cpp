@@ -1,7 +1,7 @@
 
 #define FP_FAST_FMAF
 #include <cmath>
-#include "timer.h"
+#include "benchmark.h"
 #include <iostream>
 #include <vector>
 #include <random>
@@ -54,53 +54,51 @@ void argb_poly4(
 
 int main()
 { 
-    for (int loop = 0; loop < 10; ++loop)
+    // Fill a LUT
+    std::vector<uint32_t> lut(256);
+    for (auto &i : lut)
     {
-        // Fill a LUT
-        std::vector<uint32_t> lut(256);
-        for (auto &i : lut)
-        {
-            i = std::rand(); 
-        }
-
-        // Define some values
-        float min = 0.0f;
-        float range = 1.0f;
-        size_t len = 100000000;
-        std::vector<float> in(len);
-        // Fill input
-        for (auto &i : in)
-        {
-            i = std::rand() / (float)RAND_MAX;
-        }
-        // Declare output
-        std::vector<uint32_t> out(len);
+        i = std::rand(); 
+    }
 
+    // Define some values
+    float min = 0.0f;
+    float range = 1.0f;
+    size_t len = 100000000;
+    std::vector<float> in(len);
+    // Fill input
+    for (auto &i : in)
+    {
+        i = std::rand() / (float)RAND_MAX;
+    }
+    // Declare output
+    std::vector<uint32_t> out(len);
 
-        // Time filling output from LUT
-        {
-            HighResolutionTimer timer;
+    BenchmarkHarness<> bench;
+    BenchmarkOptions opts;
+    opts.maxRepeats = 10;
+    opts.elements = (double)len;
+    opts.bytes = (double)len * (sizeof(float) + sizeof(uint32_t)); // 1 read + 1 write, LUT stays in cache
 
-            argb_lut(min, range, lut, in, out);
-        }
+    // Time filling output from LUT
+    bench.run("argb_lut", [&](){ argb_lut(min, range, lut, in, out); }, opts).print();
 
-        // Time filling output from polynomial
-        {
-            HighResolutionTimer timer;
+    // Print some output
+    for (int i = 0; i < 10; ++i)
+    {
+        int idx = std::rand() % out.size();
+        printf("%d: %d\n", idx, out.at(idx));
+    }
 
-            argb_poly4(min, range, in, out);
-        }
+    // Time filling output from polynomial
+    bench.run("argb_poly4", [&](){ argb_poly4(min, range, in, out); }, opts).print();
 
-        // Print some output
-        for (int i = 0; i < 10; ++i)
-        {
-            int idx = std::rand() % out.size();
-            printf("%d: %d\n", idx, out.at(idx));
-        }
-        
+    // Print some output
+    for (int i = 0; i < 10; ++i)
+    {
+        int idx = std::rand() % out.size();
+        printf("%d: %d\n", idx, out.at(idx));
     }
 
-    
-
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/**
+ * @brief Raw counter values at one instant, as read from a PerfCounterGroup.
+ */
+struct PerfSample
+{
+    enum Counter { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NUM_COUNTERS };
+
+    uint64_t values[NUM_COUNTERS] = {0};
+    uint64_t timeEnabled = 0;
+    uint64_t timeRunning = 0;
+};
+
+/**
+ * @brief Difference between two PerfSamples, scaled up if the kernel multiplexed the counters.
+ */
+struct PerfDelta
+{
+    double values[PerfSample::NUM_COUNTERS] = {0};
+    bool valid[PerfSample::NUM_COUNTERS] = {false};
+
+    double ipc() const {
+        return valid[PerfSample::CYCLES] && valid[PerfSample::INSTRUCTIONS] && values[PerfSample::CYCLES] > 0 ?
+            values[PerfSample::INSTRUCTIONS] / values[PerfSample::CYCLES] : 0;
+    }
+};
+
+/**
+ * @brief Per-thread hardware counters (cycles, instructions, L1D/LLC misses, branch misses)
+ *        read through Linux perf_event_open.
+ *
+ * Counters only measure the thread that constructed the group, in user space.
+ * Counters which cannot be opened (not permitted by perf_event_paranoid, missing
+ * in a VM, or not on Linux) are reported as unavailable instead of failing, so
+ * callers should check available() / PerfDelta::valid rather than assume values.
+ */
+class PerfCounterGroup
+{
+public:
+    PerfCounterGroup(){
+        for (int i = 0; i < PerfSample::NUM_COUNTERS; ++i){
+            m_fd[i] = -1;
+            m_index[i] = -1;
+        }
+#ifdef __linux__
+        const uint32_t types[PerfSample::NUM_COUNTERS] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+        };
+        const uint64_t configs[PerfSample::NUM_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+
+        int leader = -1;
+        for (int i = 0; i < PerfSample::NUM_COUNTERS; ++i){
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.disabled = leader == -1 ? 1 : 0; // the whole group is enabled through the leader
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+            if (fd == -1){
+                if (leader == -1)
+                    m_errno = errno;
+                continue;
+            }
+            if (leader == -1)
+                leader = fd;
+            m_fd[i] = fd;
+            m_index[i] = m_numOpen++;
+        }
+
+        if (leader != -1){
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            m_leader = leader;
+        }
+#endif
+    }
+
+    ~PerfCounterGroup(){
+#ifdef __linux__
+        for (int i = 0; i < PerfSample::NUM_COUNTERS; ++i)
+            if (m_fd[i] != -1)
+                close(m_fd[i]);
+#endif
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    /**
+     * @brief True if at least one counter could be opened.
+     */
+    bool available() const { return m_leader != -1; }
+
+    /**
+     * @brief True if the given counter could be opened.
+     */
+    bool available(PerfSample::Counter c) const { return m_fd[c] != -1; }
+
+    /**
+     * @brief Prints why counters are unavailable, if they are.
+     */
+    void printStatus() const {
+        if (available())
+            return;
+#ifdef __linux__
+        printf("Hardware counters unavailable (%s)%s\n", strerror(m_errno),
+               m_errno == EACCES || m_errno == EPERM ? "; check /proc/sys/kernel/perf_event_paranoid" : "");
+#else
+        printf("Hardware counters are only supported on Linux\n");
+#endif
+    }
+
+    /**
+     * @brief Reads all counters at once. Returns a zeroed sample if unavailable.
+     */
+    PerfSample read() const {
+        PerfSample s;
+#ifdef __linux__
+        if (!available())
+            return s;
+        uint64_t buf[3 + PerfSample::NUM_COUNTERS];
+        if (::read(m_leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+            return s;
+        s.timeEnabled = buf[1];
+        s.timeRunning = buf[2];
+        for (int i = 0; i < PerfSample::NUM_COUNTERS; ++i)
+            if (m_index[i] != -1 && m_index[i] < (int)buf[0])
+                s.values[i] = buf[3 + m_index[i]];
+#endif
+        return s;
+    }
+
+    /**
+     * @brief Computes the counter deltas between two samples from this group.
+     */
+    PerfDelta delta(const PerfSample& s1, const PerfSample& s2) const {
+        PerfDelta d;
+        uint64_t enabled = s2.timeEnabled - s1.timeEnabled;
+        uint64_t running = s2.timeRunning - s1.timeRunning;
+        // If the group never got onto the PMU in this section there is nothing to scale
+        if (running == 0)
+            return d;
+        double scale = static_cast<double>(enabled) / running;
+        for (int i = 0; i < PerfSample::NUM_COUNTERS; ++i){
+            d.valid[i] = available(static_cast<PerfSample::Counter>(i));
+            d.values[i] = d.valid[i] ? (s2.values[i] - s1.values[i]) * scale : 0;
+        }
+        return d;
+    }
+
+private:
+    int m_fd[PerfSample::NUM_COUNTERS];
+    int m_index[PerfSample::NUM_COUNTERS]; // position of each counter in the group read
+    int m_numOpen = 0;
+    int m_leader = -1;
+    int m_errno = 0;
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "timer.h"
+#include <cstring>
+#include <limits>
+
+/**
+ * @brief Aggregating hierarchical profiler, used through ProfileZone objects.
+ *
+ * Each thread builds its own tree of zones, keyed by the zone names along the
+ * current nesting path, e.g. recv_to_file > recv. A zone records its count,
+ * total, min and max, so memory only grows with the number of distinct paths
+ * rather than with the number of calls, and it can be left on for long runs.
+ *
+ * Entering and leaving a zone takes no locks and does not allocate, except the
+ * first time a thread enters a given path. report(), reset() and
+ * writeChromeTrace() may be called from any thread while zones are running;
+ * trace instances overwritten while writeChromeTrace() copies them are skipped.
+ *
+ * Names must outlive the profiler (string literals, or RingEventTimer-style interned strings).
+ *
+ * Example:
+ *   ZoneProfiler<> profiler;
+ *   {
+ *       ProfileZone<> outer(profiler, "recv_to_file");
+ *       {
+ *           ProfileZone<> inner(profiler, "recv");
+ *           ...
+ *       }
+ *   }
+ *   profiler.report();
+ */
+template <typename Tdur = std::chrono::milliseconds, typename Clock = std::chrono::steady_clock>
+class ZoneProfiler
+{
+public:
+    using TimePoint = typename Clock::time_point;
+
+    struct Node
+    {
+        const char* name = "";
+        Node* parent = nullptr;
+        std::atomic<Node*> firstChild{nullptr};
+        std::atomic<Node*> nextSibling{nullptr};
+
+        // single writer (the owning thread), so plain load/store pairs are enough
+        std::atomic<uint64_t> count{0};
+        std::atomic<int64_t> total{0}; // all in Clock ticks
+        std::atomic<int64_t> min{std::numeric_limits<int64_t>::max()};
+        std::atomic<int64_t> max{0};
+    };
+
+    /**
+     * @brief Constructor.
+     *
+     * @param maxThreads Maximum number of threads that may enter zones; zones on further threads are not recorded.
+     * @param traceCapacityPerThread If non-zero, each thread also keeps its most recent zone
+     *                               instances for writeChromeTrace().
+     */
+    ZoneProfiler(size_t maxThreads = 16, size_t traceCapacityPerThread = 0)
+        : m_threads(maxThreads), m_traceCapacity(traceCapacityPerThread),
+          m_id(nextInstanceId().fetch_add(1) + 1), m_created(Clock::now())
+    {
+        for (auto& thread : m_threads){
+            thread.root.name = "thread";
+            thread.current = &thread.root;
+            if (m_traceCapacity > 0)
+                thread.trace.reset(new TraceEvent[m_traceCapacity]);
+        }
+    }
+
+    ZoneProfiler(const ZoneProfiler&) = delete;
+    ZoneProfiler& operator=(const ZoneProfiler&) = delete;
+
+    /**
+     * @brief Zeroes all zone statistics. Each thread applies this on its next zone exit,
+     *        and until then its old statistics are hidden from report().
+     */
+    void reset(){
+        m_epoch.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    /**
+     * @brief Prints each thread's zone tree with count, total, mean, min, max and share of the parent's total.
+     */
+    void report(){
+        uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_threads.size(); ++i){
+            ThreadTree& thread = m_threads[i];
+            if (!thread.ready.load(std::memory_order_acquire))
+                continue;
+            if (thread.epoch.load(std::memory_order_acquire) != epoch)
+                continue; // reset requested but not yet applied by the thread, so it has nothing to show
+            printf("Thread %zu\n", i);
+            for (Node* c = thread.root.firstChild.load(std::memory_order_acquire); c != nullptr;
+                 c = c->nextSibling.load(std::memory_order_acquire))
+                printNode(c, 0, 0);
+        }
+    }
+
+    /**
+     * @brief Writes the retained zone instances as Chrome trace-event JSON (chrome://tracing, Perfetto).
+     *        Needs a non-zero traceCapacityPerThread; otherwise only the metadata is written.
+     *
+     * @param path Output file path; it is overwritten.
+     * @return True if the file was written.
+     */
+    bool writeChromeTrace(const std::string& path){
+        FILE *fp = fopen(path.c_str(), "w");
+        if (fp == NULL)
+            return false;
+        fprintf(fp, "{\"traceEvents\": [\n");
+        bool first = true;
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_threads.size(); ++i){
+            ThreadTree& thread = m_threads[i];
+            if (!thread.ready.load(std::memory_order_acquire) || m_traceCapacity == 0)
+                continue;
+            size_t n = thread.traceCount.load(std::memory_order_acquire);
+            size_t begin = n > m_traceCapacity ? n - m_traceCapacity : 0;
+            for (size_t j = begin; j < n; ++j){
+                Node* node;
+                int64_t start, end;
+                if (!readTrace(thread.trace[j % m_traceCapacity], j, node, start, end))
+                    continue; // the owning thread has since reused this slot
+                fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %zu}",
+                        first ? "" : ",\n", timer_records_detail::escapeJson(node->name).c_str(),
+                        microseconds(TimePoint(typename Clock::duration(start)) - m_created),
+                        microseconds(typename Clock::duration(end - start)), i);
+                first = false;
+            }
+        }
+        fprintf(fp, "\n], \"displayTimeUnit\": \"ns\"}\n");
+        fclose(fp);
+        return true;
+    }
+
+private:
+    template <typename, typename> friend class ProfileZone;
+
+    // One retained zone instance. seq is 2*index+1 while the owning thread writes the slot and
+    // 2*index+2 once it is done, so a reader can tell when its copy was torn by a later overwrite.
+    struct TraceEvent
+    {
+        std::atomic<size_t> seq{0};
+        std::atomic<Node*> node{nullptr};
+        std::atomic<int64_t> start{0}; // Clock ticks since its epoch
+        std::atomic<int64_t> end{0};
+    };
+
+    struct ThreadTree
+    {
+        Node root;
+        Node* current = nullptr;
+        std::deque<Node> nodes; // only grown by the owning thread; deque keeps node addresses stable
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> ready{false};
+        std::thread::id owner;
+
+        std::unique_ptr<TraceEvent[]> trace;
+        std::atomic<size_t> traceCount{0};
+    };
+
+    struct TreeCache
+    {
+        unsigned long long profilerId = 0;
+        ThreadTree* tree = nullptr;
+    };
+
+    std::vector<ThreadTree> m_threads;
+    std::atomic<size_t> m_numClaimed{0};
+    std::atomic<uint64_t> m_epoch{0};
+    size_t m_traceCapacity;
+    unsigned long long m_id;
+    TimePoint m_created;
+
+    static std::atomic<unsigned long long>& nextInstanceId(){
+        static std::atomic<unsigned long long> id{0};
+        return id;
+    }
+
+    ThreadTree* threadTree(){
+        static thread_local TreeCache cache;
+        if (cache.profilerId == m_id)
+            return cache.tree;
+
+        std::thread::id self = std::this_thread::get_id();
+        ThreadTree* found = nullptr;
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_threads.size(); ++i){
+            if (m_threads[i].ready.load(std::memory_order_acquire) && m_threads[i].owner == self){
+                found = &m_threads[i];
+                break;
+            }
+        }
+        if (found == nullptr){
+            size_t idx = m_numClaimed.fetch_add(1, std::memory_order_acq_rel);
+            if (idx >= m_threads.size())
+                return nullptr;
+            found = &m_threads[idx];
+            found->owner = self;
+            found->epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            found->ready.store(true, std::memory_order_release);
+        }
+        cache.profilerId = m_id;
+        cache.tree = found;
+        return found;
+    }
+
+    Node* enter(ThreadTree* tree, const char* name){
+        Node* parent = tree->current;
+        Node* child = parent->firstChild.load(std::memory_order_relaxed);
+        Node* last = nullptr;
+        for (; child != nullptr; child = child->nextSibling.load(std::memory_order_relaxed)){
+            if (child->name == name || strcmp(child->name, name) == 0)
+                break;
+            last = child;
+        }
+        if (child == nullptr){
+            tree->nodes.emplace_back();
+            child = &tree->nodes.back();
+            child->name = name;
+            child->parent = parent;
+            if (last == nullptr)
+                parent->firstChild.store(child, std::memory_order_release);
+            else
+                last->nextSibling.store(child, std::memory_order_release);
+        }
+        tree->current = child;
+        return child;
+    }
+
+    void exit(ThreadTree* tree, Node* node, const TimePoint& start, const TimePoint& end){
+        uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+        if (tree->epoch.load(std::memory_order_relaxed) != epoch){
+            for (Node& n : tree->nodes)
+                clearStats(n);
+            tree->epoch.store(epoch, std::memory_order_release);
+        }
+
+        int64_t elapsed = (end - start).count();
+        node->count.store(node->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        node->total.store(node->total.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+        if (elapsed < node->min.load(std::memory_order_relaxed))
+            node->min.store(elapsed, std::memory_order_relaxed);
+        if (elapsed > node->max.load(std::memory_order_relaxed))
+            node->max.store(elapsed, std::memory_order_relaxed);
+
+        if (m_traceCapacity > 0){
+            size_t n = tree->traceCount.load(std::memory_order_relaxed);
+            TraceEvent& e = tree->trace[n % m_traceCapacity];
+            e.seq.store(2 * n + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            e.node.store(node, std::memory_order_relaxed);
+            e.start.store(start.time_since_epoch().count(), std::memory_order_relaxed);
+            e.end.store(end.time_since_epoch().count(), std::memory_order_relaxed);
+            e.seq.store(2 * n + 2, std::memory_order_release);
+            tree->traceCount.store(n + 1, std::memory_order_release);
+        }
+        tree->current = node->parent;
+    }
+
+    // Copies trace instance j out of its slot; false if the slot no longer (or not yet) holds it whole
+    static bool readTrace(const TraceEvent& e, size_t j, Node*& node, int64_t& start, int64_t& end){
+        size_t seq = e.seq.load(std::memory_order_acquire);
+        if (seq != 2 * j + 2)
+            return false;
+        node = e.node.load(std::memory_order_relaxed);
+        start = e.start.load(std::memory_order_relaxed);
+        end = e.end.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return e.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    static void clearStats(Node& n){
+        n.count.store(0, std::memory_order_relaxed);
+        n.total.store(0, std::memory_order_relaxed);
+        n.min.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+        n.max.store(0, std::memory_order_relaxed);
+    }
+
+    static double units(int64_t ticks){
+        return std::chrono::duration<double, typename Tdur::period>(typename Clock::duration(ticks)).count();
+    }
+
+    template <typename Tdiff>
+    static double microseconds(const Tdiff& d){
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+
+    void printNode(Node* node, int depth, int64_t parentTotal){
+        uint64_t count = node->count.load(std::memory_order_relaxed);
+        int64_t total = node->total.load(std::memory_order_relaxed);
+        std::string unit = duration_unit_string<Tdur>();
+        printf("%*s%s : count %llu, total %f %s, mean %f %s, min %f %s, max %f %s",
+               2 * depth + 2, "", node->name, (unsigned long long)count,
+               units(total), unit.c_str(),
+               count > 0 ? units(total) / count : 0.0, unit.c_str(),
+               count > 0 ? units(node->min.load(std::memory_order_relaxed)) : 0.0, unit.c_str(),
+               units(node->max.load(std::memory_order_relaxed)), unit.c_str());
+        if (parentTotal > 0)
+            printf(" (%.1f%%)", 100.0 * total / parentTotal);
+        printf("\n");
+        for (Node* c = node->firstChild.load(std::memory_order_acquire); c != nullptr;
+             c = c->nextSibling.load(std::memory_order_acquire))
+            printNode(c, depth + 1, total);
+    }
+};
+
+/**
+ * @brief RAII zone: times the enclosing scope into the given ZoneProfiler, nested under
+ *        whichever zone is currently open on this thread.
+ */
+template <typename Tdur = std::chrono::milliseconds, typename Clock = std::chrono::steady_clock>
+class ProfileZone
+{
+public:
+    ProfileZone(ZoneProfiler<Tdur, Clock>& profiler, const char* name)
+        : m_profiler(profiler), m_tree(profiler.threadTree())
+    {
+        if (m_tree != nullptr){
+            m_node = profiler.enter(m_tree, name);
+            m_start = Clock::now();
+        }
+    }
+
+    ~ProfileZone(){
+        if (m_tree != nullptr)
+            m_profiler.exit(m_tree, m_node, m_start, Clock::now());
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    ZoneProfiler<Tdur, Clock>& m_profiler;
+    typename ZoneProfiler<Tdur, Clock>::ThreadTree* m_tree;
+    typename ZoneProfiler<Tdur, Clock>::Node* m_node = nullptr;
+    typename Clock::time_point m_start;
+};
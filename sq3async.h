@@ -0,0 +1,344 @@
+#pragma once
+
+#include "sql3ext.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+Bounded lock-free multi-producer single-consumer queue (Vyukov's bounded queue, with per-cell sequence numbers).
+All cells are allocated up front, so push() never allocates, blocks or takes a lock; it fails instead when the queue is full.
+pop() must only be called from a single consumer thread.
+*/
+template <typename T>
+class sq3mpscqueue
+{
+public:
+	sq3mpscqueue(size_t in_capacity)
+		: capacity(roundUpPow2(in_capacity < 2 ? 2 : in_capacity)), mask(capacity - 1), cells(new Cell[capacity])
+	{
+		for (size_t i = 0; i < capacity; i++)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	sq3mpscqueue(const sq3mpscqueue&) = delete;
+	sq3mpscqueue& operator=(const sq3mpscqueue&) = delete;
+
+	// value is only moved from if this returns true
+	bool push(T &value)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true)
+		{
+			cell = &cells[pos & mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq - pos);
+			if (dif == 0){
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false; // the cell still holds the value pushed one lap ago
+			else
+				pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+		cell->value = std::move(value);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// returns false if the queue is empty (or the next push is still halfway through filling its cell)
+	bool pop(T &value)
+	{
+		Cell &cell = cells[dequeuePos & mask];
+		if (cell.seq.load(std::memory_order_acquire) != dequeuePos + 1)
+			return false;
+		value = std::move(cell.value);
+		cell.value = T(); // release whatever the value held now, not a lap later
+		cell.seq.store(dequeuePos + capacity, std::memory_order_release);
+		dequeuePos++;
+		return true;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T value;
+	};
+
+	static size_t roundUpPow2(size_t n)
+	{
+		size_t p = 1;
+		while (p < n)
+			p <<= 1;
+		return p;
+	}
+
+	const size_t capacity;
+	const size_t mask;
+	std::unique_ptr<Cell[]> cells;
+	alignas(64) std::atomic<size_t> enqueuePos{0}; // producers' end
+	alignas(64) size_t dequeuePos = 0; // consumer's end
+};
+
+/*
+Owns a database on a dedicated writer thread, so callers never block on SQLite I/O or fsync.
+Jobs are queued without locks or node allocations into a ring of QueueCapacity jobs, and run in order on the writer thread;
+every flushInterval the writer drains the queue and runs the whole batch inside one transaction.
+If the ring fills up, post() wakes the writer and yields until it has made room.
+Queries return futures, and wake the writer immediately instead of waiting for the next interval.
+
+DB is sq3db or a subclass (e.g. usrpRXdb), constructed on the writer thread with the given arguments.
+
+Example:
+	sq3async<usrpRXdb> adb(std::chrono::milliseconds(200), "capture.db");
+	adb.insert("detections", second, channel, power);     // from the receive thread, never blocks
+	std::future<int> n = adb.query([](usrpRXdb &db){ ... return count; });
+*/
+template <typename DB = sq3db, size_t QueueCapacity = 65536>
+class sq3async
+{
+public:
+	using Job = std::function<void(DB&)>;
+
+	template <typename... Args>
+	sq3async(std::chrono::milliseconds in_flushInterval, Args... dbArgs)
+		: flushInterval(in_flushInterval), queue(QueueCapacity)
+	{
+		// open on the writer thread, but report failure to open here; the promise is shared, as the writer
+		// may still be inside set_value() when get() returns and this constructor moves on
+		auto opened = std::make_shared<std::promise<void>>();
+		std::future<void> openedResult = opened->get_future();
+		writer = std::thread([this, opened, dbArgs...](){
+			std::unique_ptr<DB> db;
+			try{
+				db.reset(new DB(dbArgs...));
+			}
+			catch (...){
+				opened->set_exception(std::current_exception());
+				return;
+			}
+			opened->set_value();
+			run(*db);
+		});
+		try{
+			openedResult.get();
+		}
+		catch (...){
+			writer.join();
+			throw;
+		}
+	}
+
+	// drains and commits everything still queued before closing the database
+	~sq3async()
+	{
+		stopRequested.store(true, std::memory_order_release);
+		wakeWriter();
+		writer.join();
+	}
+
+	sq3async(const sq3async&) = delete;
+	sq3async& operator=(const sq3async&) = delete;
+
+	// queues a job for the writer thread
+	void post(Job job)
+	{
+		// counted first, so pending() never sees a job done before it was posted
+		numPosted.fetch_add(1, std::memory_order_relaxed);
+		while (!queue.push(job)){
+			wakeWriter();
+			std::this_thread::yield();
+		}
+	}
+
+	// queues an insert of one row; the values are copied
+	template <typename... T>
+	void insert(const std::string &tablename, T... values)
+	{
+		post([tablename, values...](DB &db){
+			std::string stmtstr = "insert into " + tablename + " values(";
+			for (size_t i = 0; i < sizeof...(T); i++){
+				stmtstr = stmtstr + (i > 0 ? ",?" : "?");
+			}
+			stmtstr = stmtstr + ");";
+			sqlite3_stmt *stmt = db.cachedStatement(stmtstr);
+			db.bindAll(stmt, values...);
+			db.stepReset(stmt);
+		});
+	}
+
+	// queues a query; it sees all previously queued jobs, including uncommitted ones
+	template <typename F>
+	auto query(F fn) -> std::future<decltype(fn(std::declval<DB&>()))>
+	{
+		using R = decltype(fn(std::declval<DB&>()));
+		auto promise = std::make_shared<std::promise<R>>();
+		std::future<R> result = promise->get_future();
+		post([promise, fn](DB &db){
+			try{
+				setPromise(*promise, fn, db);
+			}
+			catch (...){
+				promise->set_exception(std::current_exception());
+			}
+		});
+		wakeWriter();
+		return result;
+	}
+
+	/*
+	Returns a future that is ready once everything queued so far has been committed.
+	If the batch was rolled back instead, get() throws the SQLite error (an int, as sq3db throws),
+	or SQLITE_ABORT if SQLite rolled the transaction back by itself.
+	*/
+	std::future<void> flush()
+	{
+		auto promise = std::make_shared<std::promise<void>>();
+		std::future<void> result = promise->get_future();
+		post([this, promise](DB&){
+			afterCommit.push_back(promise);
+		});
+		wakeWriter();
+		return result;
+	}
+
+	// jobs queued but not yet run
+	size_t pending() const
+	{
+		return numPosted.load(std::memory_order_relaxed) - numDone.load(std::memory_order_relaxed);
+	}
+
+	// jobs which threw (their errors are printed by the writer thread)
+	size_t failed() const
+	{
+		return numFailed.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::chrono::milliseconds flushInterval;
+	sq3mpscqueue<Job> queue;
+	std::thread writer;
+	std::atomic<bool> stopRequested{false};
+	std::atomic<size_t> numPosted{0};
+	std::atomic<size_t> numDone{0};
+	std::atomic<size_t> numFailed{0};
+
+	// only used to sleep the writer between flushes; plain inserts never take it, only wakeWriter() does, briefly
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	std::atomic<bool> wakeRequested{false};
+
+	std::vector<std::shared_ptr<std::promise<void>>> afterCommit; // flushes waiting for the batch to commit; writer thread only
+
+	template <typename R, typename F>
+	static void setPromise(std::promise<R> &promise, F &fn, DB &db)
+	{
+		promise.set_value(fn(db));
+	}
+
+	template <typename F>
+	static void setPromise(std::promise<void> &promise, F &fn, DB &db)
+	{
+		fn(db);
+		promise.set_value();
+	}
+
+	// the request is published before the lock is taken, and the writer checks it under the lock
+	// before sleeping, so a wake-up can't fall between its check and its wait and be lost
+	void wakeWriter()
+	{
+		wakeRequested.store(true, std::memory_order_release);
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wake.notify_one();
+	}
+
+	void run(DB &db)
+	{
+		while (true)
+		{
+			wakeRequested.store(false, std::memory_order_relaxed);
+			bool stopping = stopRequested.load(std::memory_order_acquire);
+			drain(db);
+			if (stopping)
+				break;
+
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait_for(lock, flushInterval, [this](){
+				return wakeRequested.load(std::memory_order_acquire) || stopRequested.load(std::memory_order_acquire);
+			});
+		}
+	}
+
+	// runs the jobs queued when it starts as one transaction (later ones wait for the next drain,
+	// so steady producers can't hold the transaction, and every flush waiting on it, open forever)
+	void drain(DB &db)
+	{
+		size_t limit = pending();
+		Job job;
+		if (!queue.pop(job))
+			return;
+
+		bool ownsTransaction = false;
+		int lostErr = SQLITE_OK; // why jobs of this batch were rolled back, if they were
+		size_t count = 0;
+		do{
+			if (!ownsTransaction && !db.inTransaction()){
+				try{
+					db.beginTransaction();
+					ownsTransaction = true;
+				}
+				catch (int err) {} // the job then runs in autocommit mode
+			}
+			try{
+				job(db);
+			}
+			catch (int err){
+				printf("Error %d in queued database job\n", err);
+				numFailed.fetch_add(1, std::memory_order_relaxed);
+			}
+			catch (const std::exception &e){
+				printf("Exception in queued database job : %s\n", e.what());
+				numFailed.fetch_add(1, std::memory_order_relaxed);
+			}
+			catch (...){
+				printf("Unknown exception in queued database job\n");
+				numFailed.fetch_add(1, std::memory_order_relaxed);
+			}
+			numDone.fetch_add(1, std::memory_order_relaxed);
+			// some errors roll the transaction back by themselves; the next job starts another
+			if (ownsTransaction && !db.inTransaction()){
+				lostErr = SQLITE_ABORT;
+				ownsTransaction = false;
+			}
+		} while (++count < limit && queue.pop(job));
+
+		if (ownsTransaction){
+			try{
+				db.endTransaction();
+			}
+			catch (int err){
+				lostErr = err;
+				try{db.exec("ROLLBACK;");}
+				catch (int err) {}
+			}
+		}
+
+		for (auto &promise : afterCommit){
+			if (lostErr == SQLITE_OK)
+				promise->set_value();
+			else
+				promise->set_exception(std::make_exception_ptr(lostErr));
+		}
+		afterCommit.clear();
+	}
+};
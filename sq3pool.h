@@ -0,0 +1,81 @@
+#pragma once
+
+#include "sql3ext.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+/*
+A fixed set of read connections to one database, so analysis threads can query in parallel
+while another connection (e.g. the recorder, opened with sq3profile::wal()) keeps writing.
+Connections are opened with sq3profile::reader() by default, which refuses writes.
+acquire() blocks until a connection is free; the lease returns it to the pool when destroyed.
+
+Example:
+	sq3pool<usrpRXdb> pool("capture.db", 4);
+	{
+		auto conn = pool.acquire();
+		conn->getBlockInfo(...);
+	}
+*/
+template <typename DB = sq3db>
+class sq3pool
+{
+public:
+	class lease
+	{
+	public:
+		lease(sq3pool &in_pool, DB *in_db) : pool(&in_pool), db(in_db) {}
+		lease(lease &&other) : pool(other.pool), db(other.db) {other.db = nullptr;}
+		~lease() {if (db != nullptr) pool->release(db);}
+
+		lease(const lease&) = delete;
+		lease& operator=(const lease&) = delete;
+
+		DB* operator->() {return db;}
+		DB& operator*() {return *db;}
+
+	private:
+		sq3pool *pool;
+		DB *db;
+	};
+
+	sq3pool(const char *in_filename, size_t numConnections, const sq3profile &profile = sq3profile::reader(),
+		int in_flags = SQLITE_OPEN_READWRITE, const char *zVfs = nullptr)
+	{
+		for (size_t i = 0; i < numConnections; i++){
+			connections.emplace_back(new DB(in_filename, profile, in_flags, zVfs));
+			available.push_back(connections.back().get());
+		}
+	}
+
+	sq3pool(const sq3pool&) = delete;
+	sq3pool& operator=(const sq3pool&) = delete;
+
+	// waits for a free connection
+	lease acquire()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [this](){ return !available.empty(); });
+		DB *db = available.back();
+		available.pop_back();
+		return lease(*this, db);
+	}
+
+	size_t size() const {return connections.size();}
+
+private:
+	std::vector<std::unique_ptr<DB>> connections;
+	std::vector<DB*> available;
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	void release(DB *db)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			available.push_back(db);
+		}
+		cv.notify_one();
+	}
+};
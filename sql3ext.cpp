@@ -1,4 +1,5 @@
 #include "sql3ext.h"
+#include <cctype>
 
 sq3db::sq3db(const char *in_filename, int in_flags, const char *zVfs){
 	
@@ -19,6 +20,58 @@ sq3db::sq3db(const char *in_filename, int in_flags, const char *zVfs){
 	}
 }
 
+sq3db::sq3db(const char *in_filename, const sq3profile &profile, int in_flags, const char *zVfs)
+	: sq3db(in_filename, in_flags, zVfs)
+{
+	// delegated construction is complete here, so the destructor closes the database if this throws
+	applyProfile(profile);
+}
+
+void sq3db::applyProfile(const sq3profile &profile)
+{
+	if (profile.busyTimeoutMs > 0)
+	{
+		sqlite3_busy_timeout(db, profile.busyTimeoutMs);
+	}
+	if (profile.journalMode != "")
+	{
+		// journal_mode reports the mode actually in effect, which can differ (e.g. in-memory databases)
+		sqlite3_stmt *stmt = 0;
+		prepStatement(&stmt, "pragma journal_mode=" + profile.journalMode + ";");
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			std::string mode((const char*)sqlite3_column_text(stmt, 0));
+			std::string requested(profile.journalMode);
+			std::transform(requested.begin(), requested.end(), requested.begin(), ::tolower);
+			if (mode != requested)
+			{
+				printf("Requested journal_mode %s but database is using %s\n", profile.journalMode.c_str(), mode.c_str());
+			}
+		}
+		sqlite3_finalize(stmt);
+	}
+	if (profile.synchronous != "")
+	{
+		exec("pragma synchronous=" + profile.synchronous + ";");
+	}
+	if (profile.mmapSize >= 0)
+	{
+		exec("pragma mmap_size=" + std::to_string(profile.mmapSize) + ";");
+	}
+	if (profile.cacheSize != 0)
+	{
+		exec("pragma cache_size=" + std::to_string(profile.cacheSize) + ";");
+	}
+	if (profile.tempStore != "")
+	{
+		exec("pragma temp_store=" + profile.tempStore + ";");
+	}
+	if (profile.queryOnly)
+	{
+		exec("pragma query_only=1;");
+	}
+}
+
 void sq3db::createTable(std::string &tablename, std::vector<std::string> &columnnames, std::vector<std::string> &columntypes, bool ifNotExists)
 {
 	// construct statement
@@ -61,18 +114,13 @@ std::vector<std::string> sq3db::getTableNames(std::string pattern)
 	sqlite3_stmt* stmt = 0;
 	prepStatement(&stmt, stmtstr);
 	
-	// begin
-	beginTransaction();
-	
+	// no explicit transaction: a single read statement is already consistent, and wrapping it would fail inside an outer transaction
 	// loop over results
 	while (sqlite3_step(stmt) == SQLITE_ROW){
 		// deep copy into strings
 		r.push_back(std::string((const char*)sqlite3_column_text(stmt, 0)));
 	}
 	
-	// end
-	endTransaction();
-	
 	// free statement
 	err = sqlite3_finalize(stmt);
 	if (err != SQLITE_OK)
@@ -86,82 +134,101 @@ std::vector<std::string> sq3db::getTableNames(std::string pattern)
 
 /*
 Note that this is really for convenience (e.g. retrieving to display in table).
-For real storage of the data you would need to know the type already.
+For real storage of the data you would need to know the type already (see getColumns()).
 */
-std::vector<std::string> sq3db::getColumnNames(std::string &tablename)
+std::vector<std::string> sq3db::getColumnNames(const std::string &tablename)
 {
 	// create return vector
 	std::vector<std::string> r;
 	
-	// create statement string
-	std::string stmtstr = "select sql from sqlite_master where tbl_name = '" + tablename + "' AND type = 'table';";
-	
-	std::cout << "Statement executed is : " << stmtstr << std::endl;
-	
-	// prepare statement
-	sqlite3_stmt *stmt = 0;
-	prepStatement(&stmt, stmtstr);
+	const std::vector<sq3column> &columns = getColumns(tablename);
+	for (size_t i = 0; i < columns.size(); i++){
+		r.push_back(columns[i].name);
+	}
 	
-	// begin
-	beginTransaction();
+	return r;
 	
-	// loop over results (there's really only one)
-	std::string original;
-	while (sqlite3_step(stmt) == SQLITE_ROW)
+}
+
+// the rules from https://www.sqlite.org/datatype3.html#determination_of_column_affinity, in order
+static sq3column::Affinity columnAffinity(std::string type)
+{
+	std::transform(type.begin(), type.end(), type.begin(), ::toupper);
+	if (type.find("INT") != std::string::npos)
+		return sq3column::INTEGER;
+	if (type.find("CHAR") != std::string::npos || type.find("CLOB") != std::string::npos || type.find("TEXT") != std::string::npos)
+		return sq3column::TEXT;
+	if (type.find("BLOB") != std::string::npos || type.empty())
+		return sq3column::BLOB;
+	if (type.find("REAL") != std::string::npos || type.find("FLOA") != std::string::npos || type.find("DOUB") != std::string::npos)
+		return sq3column::REAL;
+	return sq3column::NUMERIC;
+}
+
+const std::vector<sq3column>& sq3db::getColumns(const std::string &tablename)
+{
+	// schema_version is bumped by every schema change, including ones made on other connections
+	sqlite3_stmt *stmt = cachedStatement("pragma schema_version;");
+	long long version = -1;
+	if (sqlite3_step(stmt) == SQLITE_ROW)
 	{
-		// deep copy into strings
-		original = std::string((const char*)sqlite3_column_text(stmt, 0));
+		version = sqlite3_column_int64(stmt, 0);
 	}
-	
-	// end
-	endTransaction();
-	
-	// free statement
-	err = sqlite3_finalize(stmt);
-	if (err != SQLITE_OK)
+	sqlite3_reset(stmt);
+	if (version != schemaVersion)
 	{
-		printf("Error %d finalizing statement : %s \n", err, sqlite3_errmsg(db));
-		throw err;
+		schemaCache.clear();
+		schemaVersion = version;
 	}
 	
-	// parse the statement
-	std::regex re("[()]+");
-	std::sregex_token_iterator it{ original.begin(),  
-                             original.end(), re, -1 }; 
-    std::vector<std::string> tokenized{ it, {} }; 
-  
-    // Additional check to remove empty strings 
-    tokenized.erase( 
-        std::remove_if(tokenized.begin(),  
-                            tokenized.end(), 
-                       [](std::string const& s) { 
-                           return s.size() == 0; 
-                       }), 
-        tokenized.end()); 
-  
-	// we use the last string and split on commas first
-	std::regex commare(",");
-	std::sregex_token_iterator fcolit{tokenized.back().begin(), tokenized.back().end(), commare, -1 };
-	std::vector<std::string> columnfulltokens{fcolit, {} };
-	
-	// then now split on spaces, and take the first one of each
-	std::regex spacere("\\s+");
-	for (int i = 0; i < columnfulltokens.size(); i++){
-		std::sregex_token_iterator spaceit{columnfulltokens.at(i).begin(), columnfulltokens.at(i).end(), spacere, -1};
-		std::vector<std::string> columntokens{spaceit, {}};
-		r.push_back(columntokens.front());
+	auto it = schemaCache.find(tablename);
+	if (it != schemaCache.end())
+	{
+		return it->second;
 	}
 	
-	return r;
+	std::vector<sq3column> columns;
+	stmt = cachedStatement("select name, type, \"notnull\", pk from pragma_table_info(?) order by cid;");
+	bindAll(stmt, tablename);
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		sq3column c;
+		sq3read(stmt, 0, c.name);
+		sq3read(stmt, 1, c.type);
+		c.affinity = columnAffinity(c.type);
+		c.notNull = sqlite3_column_int(stmt, 2) != 0;
+		c.primaryKey = sqlite3_column_int(stmt, 3);
+		columns.push_back(c);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
 	
+	return schemaCache[tablename] = columns;
 }
 
 /*
-Note that this still enumerates all the rows internally, so it's a good idea to keep the row count somewhere else.
+Without trackRowCount() this enumerates all the rows internally; with it, this is a single-row lookup.
 */
-int sq3db::getRowCount(std::string &tablename)
+int sq3db::getRowCount(const std::string &tablename)
 {
-	int r;
+	int r = 0;
+	
+	if (summaryExists())
+	{
+		sqlite3_stmt *stmt = cachedStatement("select rows from sq3_summary where tbl = ? and col = '';");
+		bindAll(stmt, tablename);
+		bool found = sqlite3_step(stmt) == SQLITE_ROW;
+		if (found)
+		{
+			r = sqlite3_column_int(stmt, 0);
+		}
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		if (found)
+		{
+			return r;
+		}
+	}
 	
 	// create statement string
 	std::string stmtstr = "select count(*) from " + tablename;
@@ -171,19 +238,12 @@ int sq3db::getRowCount(std::string &tablename)
 	sqlite3_stmt *stmt = 0;
 	prepStatement(&stmt, stmtstr);
 	
-	// begin
-	beginTransaction();
-	
 	// loop over results (there's really only one)
-	std::string original;
 	while (sqlite3_step(stmt) == SQLITE_ROW)
 	{
 		r = sqlite3_column_int(stmt, 0);
 	}
 	
-	// end
-	endTransaction();
-	
 	// free statement
 	err = sqlite3_finalize(stmt);
 	if (err != SQLITE_OK)
@@ -195,7 +255,183 @@ int sq3db::getRowCount(std::string &tablename)
 	return r;
 }
 
-void sq3db::exec(std::string &stmtstr)
+// quoting for names/values pasted into the summary triggers
+static std::string quoteIdentifier(const std::string &name)
+{
+	std::string r = "\"";
+	for (char c : name){
+		r += c;
+		if (c == '"') r += '"';
+	}
+	return r + "\"";
+}
+
+static std::string quoteLiteral(const std::string &value)
+{
+	std::string r = "'";
+	for (char c : value){
+		r += c;
+		if (c == '\'') r += '\'';
+	}
+	return r + "'";
+}
+
+bool sq3db::summaryExists()
+{
+	if (summaryTableExists)
+	{
+		return true;
+	}
+	sqlite3_stmt *stmt = cachedStatement("select 1 from sqlite_master where type = 'table' and name = 'sq3_summary';");
+	summaryTableExists = sqlite3_step(stmt) == SQLITE_ROW;
+	sqlite3_reset(stmt);
+	return summaryTableExists;
+}
+
+void sq3db::createSummaryTable()
+{
+	exec("create table if not exists sq3_summary("
+		"tbl text not null, col text not null, rows integer not null default 0, "
+		"minval, maxval, total real, triggered integer not null, "
+		"primary key(tbl, col)) without rowid;");
+	summaryTableExists = true;
+}
+
+void sq3db::trackRowCount(const std::string &tablename, bool viaTriggers)
+{
+	createSummaryTable();
+	
+	std::string tbl = quoteIdentifier(tablename);
+	std::string lit = quoteLiteral(tablename);
+	std::string update = "update sq3_summary set rows = rows %s 1 where tbl = " + lit + " and col = '';";
+	
+	bool ownsTransaction = !inTransaction();
+	if (ownsTransaction)
+		beginTransaction();
+	try{
+		// the count is taken in the same transaction as the triggers are created, so no row is missed or counted twice
+		exec("drop trigger if exists " + quoteIdentifier("sq3_rows_ins_" + tablename) + ";");
+		exec("drop trigger if exists " + quoteIdentifier("sq3_rows_del_" + tablename) + ";");
+		exec("insert or replace into sq3_summary(tbl, col, rows, triggered) select " + lit + ", '', count(*), " +
+			(viaTriggers ? "1" : "0") + " from " + tbl + ";");
+		if (viaTriggers)
+		{
+			exec("create trigger " + quoteIdentifier("sq3_rows_ins_" + tablename) + " after insert on " + tbl +
+				" begin update sq3_summary set rows = rows + 1 where tbl = " + lit + " and col = ''; end;");
+			exec("create trigger " + quoteIdentifier("sq3_rows_del_" + tablename) + " after delete on " + tbl +
+				" begin update sq3_summary set rows = rows - 1 where tbl = " + lit + " and col = ''; end;");
+		}
+		if (ownsTransaction)
+			endTransaction();
+	}
+	catch (int err){
+		if (ownsTransaction)
+			exec("ROLLBACK;");
+		throw err;
+	}
+}
+
+void sq3db::trackColumnSummary(const std::string &tablename, const std::string &columnname)
+{
+	createSummaryTable();
+	
+	std::string tbl = quoteIdentifier(tablename);
+	std::string col = quoteIdentifier(columnname);
+	std::string where = " where tbl = " + quoteLiteral(tablename) + " and col = " + quoteLiteral(columnname) + ";";
+	std::string trig = tablename + "_" + columnname;
+	
+	// min/max only widen with the new value (nulls are ignored, as in min()/max())
+	std::string widen =
+		"minval = case when new." + col + " is null then minval when minval is null or new." + col + " < minval then new." + col + " else minval end, "
+		"maxval = case when new." + col + " is null then maxval when maxval is null or new." + col + " > maxval then new." + col + " else maxval end";
+	
+	bool ownsTransaction = !inTransaction();
+	if (ownsTransaction)
+		beginTransaction();
+	try{
+		exec("drop trigger if exists " + quoteIdentifier("sq3_sum_ins_" + trig) + ";");
+		exec("drop trigger if exists " + quoteIdentifier("sq3_sum_del_" + trig) + ";");
+		exec("drop trigger if exists " + quoteIdentifier("sq3_sum_upd_" + trig) + ";");
+		exec("insert or replace into sq3_summary(tbl, col, rows, minval, maxval, total, triggered) select " +
+			quoteLiteral(tablename) + ", " + quoteLiteral(columnname) + ", count(" + col + "), min(" + col + "), max(" + col + "), total(" + col + "), 1 from " + tbl + ";");
+		exec("create trigger " + quoteIdentifier("sq3_sum_ins_" + trig) + " after insert on " + tbl +
+			" begin update sq3_summary set rows = rows + (new." + col + " is not null), total = total + coalesce(new." + col + ", 0), " +
+			widen + where + " end;");
+		exec("create trigger " + quoteIdentifier("sq3_sum_del_" + trig) + " after delete on " + tbl +
+			" begin update sq3_summary set rows = rows - (old." + col + " is not null), total = total - coalesce(old." + col + ", 0)" +
+			where + " end;");
+		exec("create trigger " + quoteIdentifier("sq3_sum_upd_" + trig) + " after update of " + col + " on " + tbl +
+			" begin update sq3_summary set rows = rows - (old." + col + " is not null) + (new." + col + " is not null), " +
+			"total = total - coalesce(old." + col + ", 0) + coalesce(new." + col + ", 0), " + widen + where + " end;");
+		if (ownsTransaction)
+			endTransaction();
+	}
+	catch (int err){
+		if (ownsTransaction)
+			exec("ROLLBACK;");
+		throw err;
+	}
+}
+
+bool sq3db::getColumnSummary(const std::string &tablename, const std::string &columnname, sq3summary &summary)
+{
+	if (!summaryExists())
+	{
+		return false;
+	}
+	sqlite3_stmt *stmt = cachedStatement("select rows, minval, maxval, total from sq3_summary where tbl = ? and col = ?;");
+	bindAll(stmt, tablename, columnname);
+	bool found = sqlite3_step(stmt) == SQLITE_ROW;
+	if (found)
+	{
+		sq3read(stmt, 0, summary.rows);
+		sq3read(stmt, 1, summary.min);
+		sq3read(stmt, 2, summary.max);
+		sq3read(stmt, 3, summary.total);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return found;
+}
+
+void sq3db::refreshSummary(const std::string &tablename)
+{
+	if (!summaryExists())
+	{
+		return;
+	}
+	
+	// find what is tracked for this table
+	std::vector<std::string> cols;
+	std::vector<int> triggered;
+	sq3cursor<std::string, int> cur(*this, "select col, triggered from sq3_summary where tbl = ?;");
+	cur.bindParams(tablename);
+	cur.fetch(0, cols, triggered);
+	
+	for (size_t i = 0; i < cols.size(); i++){
+		if (cols[i] == "")
+		{
+			trackRowCount(tablename, triggered[i] != 0);
+		}
+		else
+		{
+			trackColumnSummary(tablename, cols[i]);
+		}
+	}
+}
+
+void sq3db::addRowCount(const std::string &tablename, long long numRows)
+{
+	if (!summaryExists())
+	{
+		return;
+	}
+	sqlite3_stmt *stmt = cachedStatement("update sq3_summary set rows = rows + ? where tbl = ? and col = '' and triggered = 0;");
+	bindAll(stmt, numRows, tablename);
+	stepReset(stmt);
+}
+
+void sq3db::exec(const std::string &stmtstr)
 {
 	err = sqlite3_exec(db, stmtstr.c_str(), 0, 0, 0);
 	if (err != SQLITE_OK)
@@ -207,7 +443,7 @@ void sq3db::exec(std::string &stmtstr)
 
 
 
-void sq3db::prepStatement(sqlite3_stmt **stmt, std::string &stmtstr)
+void sq3db::prepStatement(sqlite3_stmt **stmt, const std::string &stmtstr)
 {
 	err = sqlite3_prepare_v2(
 		  db,            /* Database handle */
@@ -242,9 +478,111 @@ void sq3db::endTransaction()
 		throw err;
 	}
 }
-	
+
+bool sq3db::inTransaction()
+{
+	return sqlite3_get_autocommit(db) == 0;
+}
+
+sqlite3_stmt* sq3db::cachedStatement(const std::string &stmtstr)
+{
+	auto it = stmtCache.find(stmtstr);
+	if (it != stmtCache.end())
+	{
+		return it->second;
+	}
+
+	sqlite3_stmt *stmt = 0;
+	prepStatement(&stmt, stmtstr);
+	stmtCache[stmtstr] = stmt;
+	return stmt;
+}
+
+void sq3db::clearStatementCache()
+{
+	for (auto &kv : stmtCache)
+	{
+		sqlite3_finalize(kv.second);
+	}
+	stmtCache.clear();
+}
+
+void sq3db::bind(sqlite3_stmt *stmt, int idx, long long value)
+{
+	err = sqlite3_bind_int64(stmt, idx, value);
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d binding int64 to parameter %d : %s \n", err, idx, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
+void sq3db::bind(sqlite3_stmt *stmt, int idx, double value)
+{
+	err = sqlite3_bind_double(stmt, idx, value);
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d binding double to parameter %d : %s \n", err, idx, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
+void sq3db::bind(sqlite3_stmt *stmt, int idx, const std::string &value)
+{
+	err = sqlite3_bind_text(stmt, idx, value.c_str(), (int)value.size(), SQLITE_TRANSIENT);
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d binding text to parameter %d : %s \n", err, idx, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
+void sq3db::bind(sqlite3_stmt *stmt, int idx, const char *value)
+{
+	err = sqlite3_bind_text(stmt, idx, value, -1, SQLITE_STATIC);
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d binding text to parameter %d : %s \n", err, idx, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
+void sq3db::bind(sqlite3_stmt *stmt, int idx, const sq3blob &value)
+{
+	err = sqlite3_bind_blob(stmt, idx, value.data, value.bytes, SQLITE_STATIC);
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d binding blob to parameter %d : %s \n", err, idx, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
+void sq3db::bind(sqlite3_stmt *stmt, int idx, std::nullptr_t)
+{
+	err = sqlite3_bind_null(stmt, idx);
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d binding null to parameter %d : %s \n", err, idx, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
+void sq3db::stepReset(sqlite3_stmt *stmt)
+{
+	err = sqlite3_step(stmt);
+	// reset regardless, so a failed statement can still be reused
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	if (err != SQLITE_DONE)
+	{
+		printf("Error %d stepping statement : %s \n", err, sqlite3_errmsg(db));
+		throw err;
+	}
+}
+
 
 sq3db::~sq3db(){
 	printf("Cleaning up database %s\n", filename);
+	clearStatementCache();
 	sqlite3_close(db);
 }
\ No newline at end of file
@@ -1,35 +1,439 @@
+#pragma once
+
 #include <sqlite3.h>
 #include <iostream>
 #include <vector>
 #include <string>
-#include <regex>
+#include <algorithm>
+#include <tuple>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+#include <exception>
+
+// one column of a table, as reported by pragma table_info
+struct sq3column
+{
+	enum Affinity { INTEGER, REAL, TEXT, BLOB, NUMERIC };
+
+	std::string name;
+	std::string type; // as declared, e.g. "int", "varchar(16)", or empty
+	Affinity affinity; // derived from the declared type by SQLite's rules
+	bool notNull;
+	int primaryKey; // 1-based position in the primary key, or 0
+};
+
+// maintained aggregates of one column (see sq3db::trackColumnSummary)
+struct sq3summary
+{
+	long long rows; // non-null values
+	double min;
+	double max;
+	double total;
+};
+
+// wrapper to bind a blob parameter (the data is not copied, so it must stay valid until the statement is stepped)
+struct sq3blob
+{
+	const void *data;
+	int bytes;
+};
+
+/*
+Connection tuning applied right after opening. Empty/negative/zero fields leave SQLite's default in place.
+WAL lets readers on other connections keep reading while a single writer commits,
+and synchronous=NORMAL under WAL only fsyncs at checkpoints, at the cost of the last commits on power loss (never corruption).
+*/
+struct sq3profile
+{
+	std::string journalMode = "";   // e.g. "wal", "delete"
+	std::string synchronous = "";   // e.g. "normal", "full", "off"
+	long long mmapSize = -1;        // bytes of the file to memory-map for reads
+	int cacheSize = 0;              // pages if positive, KiB if negative (as in pragma cache_size)
+	std::string tempStore = "";     // e.g. "memory"
+	int busyTimeoutMs = 0;          // how long to retry on a locked database before returning SQLITE_BUSY
+	bool queryOnly = false;         // refuse all writes on this connection
+
+	// leaves everything as SQLite's default (rollback journal, synchronous=full)
+	static sq3profile defaults() {return sq3profile();}
+
+	// for the connection that records/ingests
+	static sq3profile wal()
+	{
+		sq3profile p;
+		p.journalMode = "wal";
+		p.synchronous = "normal";
+		p.mmapSize = 256LL << 20;
+		p.cacheSize = -65536; // 64 MiB
+		p.tempStore = "memory";
+		p.busyTimeoutMs = 5000;
+		return p;
+	}
+
+	// for analysis connections reading alongside a WAL writer
+	static sq3profile reader()
+	{
+		sq3profile p = wal();
+		p.journalMode = ""; // the writer sets it; it is persistent in the file
+		p.mmapSize = 1LL << 30;
+		p.queryOnly = true;
+		return p;
+	}
+};
 
 class sq3db{
-	
+
 public:
 	sq3db(const char *in_filename, int in_flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, const char *zVfs = nullptr);
+	sq3db(const char *in_filename, const sq3profile &profile, int in_flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, const char *zVfs = nullptr);
 	~sq3db();
-	
+
+	void applyProfile(const sq3profile &profile);
+
 	void createTable(std::string &tablename, std::vector<std::string> &columnnames, std::vector<std::string> &columntypes, bool ifNotExists=true);
 	std::vector<std::string> getTableNames(std::string pattern="");
-	std::vector<std::string> getColumnNames(std::string &tablename);
-	int getRowCount(std::string &tablename);
-	
+	std::vector<std::string> getColumnNames(const std::string &tablename);
+
+	// column metadata, read once per table and cached until the schema changes (from any connection); empty if there is no such table.
+	// The reference is only valid until the next call.
+	const std::vector<sq3column>& getColumns(const std::string &tablename);
+	int getRowCount(const std::string &tablename);
+
 	// for simple statements
-	void exec(std::string &stmtstr);
-	
+	void exec(const std::string &stmtstr);
+
 	// as a reminder, any database which inherits from this should implement a virtual select function..
 	void selectColumns() {std::cout << "Unimplemented generic select function." << std::endl;}
-	
-	void prepStatement(sqlite3_stmt **stmt, std::string &stmtstr);
+
+	void prepStatement(sqlite3_stmt **stmt, const std::string &stmtstr);
 	void beginTransaction();
 	void endTransaction();
 
+	// prepared statements cached by their SQL text; they are owned (and finalized) by the database, so don't finalize them yourself
+	sqlite3_stmt* cachedStatement(const std::string &stmtstr);
+	void clearStatementCache();
+
+	// binding for prepared statements; idx is 1-based as in sqlite3_bind_*
+	void bind(sqlite3_stmt *stmt, int idx, long long value);
+	void bind(sqlite3_stmt *stmt, int idx, double value);
+	void bind(sqlite3_stmt *stmt, int idx, const std::string &value); // transient, so it is copied
+	void bind(sqlite3_stmt *stmt, int idx, const char *value); // static, so it is not copied
+	void bind(sqlite3_stmt *stmt, int idx, const sq3blob &value);
+	void bind(sqlite3_stmt *stmt, int idx, std::nullptr_t);
+
+	// any other integer/floating type is widened, so that e.g. int64_t and float don't need their own overloads
+	template <typename I>
+	typename std::enable_if<std::is_integral<I>::value>::type bind(sqlite3_stmt *stmt, int idx, I value)
+	{
+		bind(stmt, idx, static_cast<long long>(value));
+	}
+	template <typename F>
+	typename std::enable_if<std::is_floating_point<F>::value>::type bind(sqlite3_stmt *stmt, int idx, F value)
+	{
+		bind(stmt, idx, static_cast<double>(value));
+	}
+
+	template <typename... T>
+	void bindAll(sqlite3_stmt *stmt, const T&... values)
+	{
+		int idx = 1;
+		(void)idx;
+		(void)std::initializer_list<int>{ (bind(stmt, idx++, values), 0)... };
+	}
+
+	// steps a statement that returns no rows, then resets it and clears its bindings for reuse
+	void stepReset(sqlite3_stmt *stmt);
+
+	// bulk insert, preparing the statement once and committing every batchSize rows
+	template <typename... T>
+	void insertRows(const std::string &tablename, const std::vector<std::tuple<T...>> &rows, size_t batchSize = 10000);
+
+	// typed columnar read; appends every result row of the query to the column vectors and returns the number of rows read
+	template <typename... T>
+	size_t select(const std::string &stmtstr, std::vector<T>&... columns);
+
+	bool inTransaction();
+	sqlite3* handle() {return db;}
+
+	/*
+	Maintained summaries, kept in the sq3_summary table so that getRowCount() and getColumnSummary() are single-row lookups.
+	Each starts with one full scan of the table.
+	With viaTriggers, every insert/delete from any connection updates the count, at roughly twice the cost per inserted row.
+	Without, only rows inserted through sq3inserter/insertRows (and usrpRXdb blocks) are counted, once per batch;
+	any other insert or delete leaves the count stale until refreshSummary().
+	Column summaries always use triggers. Their min/max only ever widen, so after deletes they are bounds rather than exact.
+	*/
+	void trackRowCount(const std::string &tablename, bool viaTriggers = true);
+	void trackColumnSummary(const std::string &tablename, const std::string &columnname);
+	bool getColumnSummary(const std::string &tablename, const std::string &columnname, sq3summary &summary);
+	void refreshSummary(const std::string &tablename);
+	// adds to a row count maintained without triggers; no-op if the table's count isn't maintained that way
+	void addRowCount(const std::string &tablename, long long numRows);
+
 private:
 	sqlite3 *db;
 	int flags;
 	char filename[256];
 	int err;
 	char errMsg[256];
-	
-};
\ No newline at end of file
+
+	std::unordered_map<std::string, sqlite3_stmt*> stmtCache;
+
+	std::unordered_map<std::string, std::vector<sq3column>> schemaCache;
+	long long schemaVersion = -1;
+
+	bool summaryExists();
+	void createSummaryTable();
+	bool summaryTableExists = false; // only positive results are cached, since another connection may create it
+
+};
+
+/*
+Streams rows into a table through one cached prepared statement.
+Rows are committed in transactions of batchSize rows, and the remainder is committed by flush() or on destruction.
+If the database is already inside a transaction when a batch starts, the rows simply join it instead.
+If an insert fails (or the inserter is destroyed by an exception), the uncommitted batch is rolled back rather than committed.
+
+Example:
+	sq3inserter<long long, double> ins(db, "t", 1000);
+	for (...) ins.insert(second, power);
+*/
+template <typename... T>
+class sq3inserter
+{
+public:
+	sq3inserter(sq3db &in_db, const std::string &tablename, size_t in_batchSize = 10000)
+		: db(in_db), table(tablename), batchSize(in_batchSize)
+	{
+		size_t numColumns = db.getColumns(tablename).size();
+		if (numColumns != 0 && numColumns != sizeof...(T)){
+			printf("Inserter for %s has %zu values but the table has %zu columns\n", tablename.c_str(), sizeof...(T), numColumns);
+			throw SQLITE_MISMATCH;
+		}
+
+		std::string stmtstr = "insert into " + tablename + " values(";
+		for (size_t i = 0; i < sizeof...(T); i++){
+			stmtstr = stmtstr + (i > 0 ? ",?" : "?");
+		}
+		stmtstr = stmtstr + ");";
+		stmt = db.cachedStatement(stmtstr);
+	}
+
+	~sq3inserter()
+	{
+		try{
+			if (std::uncaught_exceptions() > uncaught)
+				rollback();
+			else
+				flush();
+		}
+		catch (int err) {printf("Error %d flushing inserter on destruction\n", err);}
+	}
+
+	void insert(const T&... values)
+	{
+		if (pending == 0 && !db.inTransaction()){
+			db.beginTransaction();
+			ownsTransaction = true;
+		}
+		try{
+			db.bindAll(stmt, values...);
+			db.stepReset(stmt);
+		}
+		catch (int err){
+			rollback();
+			throw err;
+		}
+		pending++;
+		if (pending >= batchSize){
+			flush();
+		}
+	}
+
+	void insert(const std::tuple<T...> &row)
+	{
+		insertTuple(row, std::index_sequence_for<T...>{});
+	}
+
+	// commits any pending rows
+	void flush()
+	{
+		if (pending > 0){
+			db.addRowCount(table, (long long)pending);
+		}
+		if (ownsTransaction){
+			db.endTransaction();
+			ownsTransaction = false;
+		}
+		pending = 0;
+	}
+
+	// discards the pending rows, rolling back the batch if this inserter began its transaction
+	// (rows that joined an outer transaction are left for its owner to roll back)
+	void rollback()
+	{
+		pending = 0;
+		if (ownsTransaction){
+			ownsTransaction = false;
+			db.exec("ROLLBACK;");
+		}
+	}
+
+private:
+	sq3db &db;
+	std::string table;
+	sqlite3_stmt *stmt;
+	size_t batchSize;
+	size_t pending = 0;
+	bool ownsTransaction = false;
+	int uncaught = std::uncaught_exceptions();
+
+	template <size_t... I>
+	void insertTuple(const std::tuple<T...> &row, std::index_sequence<I...>)
+	{
+		insert(std::get<I>(row)...);
+	}
+};
+
+template <typename... T>
+void sq3db::insertRows(const std::string &tablename, const std::vector<std::tuple<T...>> &rows, size_t batchSize)
+{
+	sq3inserter<T...> ins(*this, tablename, batchSize);
+	for (size_t i = 0; i < rows.size(); i++){
+		ins.insert(rows[i]);
+	}
+	ins.flush();
+}
+
+// reading a result column straight into a typed value
+template <typename I>
+typename std::enable_if<std::is_integral<I>::value>::type sq3read(sqlite3_stmt *stmt, int col, I &out)
+{
+	out = static_cast<I>(sqlite3_column_int64(stmt, col));
+}
+
+template <typename F>
+typename std::enable_if<std::is_floating_point<F>::value>::type sq3read(sqlite3_stmt *stmt, int col, F &out)
+{
+	out = static_cast<F>(sqlite3_column_double(stmt, col));
+}
+
+inline void sq3read(sqlite3_stmt *stmt, int col, std::string &out)
+{
+	const char *text = (const char*)sqlite3_column_text(stmt, col);
+	out.assign(text != nullptr ? text : "", sqlite3_column_bytes(stmt, col));
+}
+
+/*
+Pages through the results of a query, writing each column straight into typed buffers without building per-row objects.
+The statement is owned by the cursor, so several cursors can be open at once.
+
+Example:
+	sq3cursor<long long, double> cur(db, "select second, power from detections where power > ?");
+	cur.bindParams(10.0);
+	std::vector<long long> seconds; std::vector<double> powers;
+	while (cur.fetch(100000, seconds, powers) > 0) { ... process the page ... ; seconds.clear(); powers.clear(); }
+
+or into preallocated raw buffers (e.g. from ippsMalloc), maxRows at a time:
+	size_t n = cur.fetch(maxRows, secondsPtr, powersPtr);
+*/
+template <typename... T>
+class sq3cursor
+{
+public:
+	sq3cursor(sq3db &in_db, const std::string &stmtstr)
+		: db(in_db)
+	{
+		db.prepStatement(&stmt, stmtstr);
+		int numCols = sqlite3_column_count(stmt);
+		if (numCols != (int)sizeof...(T))
+		{
+			printf("Query returns %d columns but cursor has %zu types : %s \n", numCols, sizeof...(T), stmtstr.c_str());
+			sqlite3_finalize(stmt);
+			throw SQLITE_MISMATCH;
+		}
+	}
+
+	~sq3cursor()
+	{
+		sqlite3_finalize(stmt);
+	}
+
+	sq3cursor(const sq3cursor&) = delete;
+	sq3cursor& operator=(const sq3cursor&) = delete;
+
+	// binds the query's ? parameters, restarting the cursor
+	template <typename... A>
+	void bindParams(const A&... params)
+	{
+		reset();
+		sqlite3_clear_bindings(stmt);
+		db.bindAll(stmt, params...);
+	}
+
+	// appends up to maxRows rows (0 for all remaining) to the vectors; returns the number of rows read
+	size_t fetch(size_t maxRows, std::vector<T>&... columns)
+	{
+		size_t n = 0;
+		while ((maxRows == 0 || n < maxRows) && step())
+		{
+			int col = 0;
+			(void)col;
+			(void)std::initializer_list<int>{ (columns.emplace_back(), sq3read(stmt, col++, columns.back()), 0)... };
+			n++;
+		}
+		return n;
+	}
+
+	// writes up to maxRows rows into buffers of at least maxRows elements each; returns the number of rows written
+	size_t fetch(size_t maxRows, T*... columns)
+	{
+		size_t n = 0;
+		while (n < maxRows && step())
+		{
+			int col = 0;
+			(void)col;
+			(void)std::initializer_list<int>{ (sq3read(stmt, col++, columns[n]), 0)... };
+			n++;
+		}
+		return n;
+	}
+
+	// true once every row has been read
+	bool done() const {return finished;}
+
+	// restarts the query from the first row, keeping the bound parameters
+	void reset()
+	{
+		sqlite3_reset(stmt);
+		finished = false;
+	}
+
+private:
+	sq3db &db;
+	sqlite3_stmt *stmt = 0;
+	bool finished = false;
+
+	bool step()
+	{
+		if (finished)
+			return false;
+		int err = sqlite3_step(stmt);
+		if (err == SQLITE_ROW)
+			return true;
+		finished = true;
+		if (err != SQLITE_DONE)
+		{
+			printf("Error %d stepping cursor : %s \n", err, sqlite3_errmsg(db.handle()));
+			throw err;
+		}
+		return false;
+	}
+};
+
+template <typename... T>
+size_t sq3db::select(const std::string &stmtstr, std::vector<T>&... columns)
+{
+	sq3cursor<T...> cur(*this, stmtstr);
+	return cur.fetch(0, columns...);
+}
@@ -1,14 +1,66 @@
+#pragma once
+
 #include <chrono>
 #include <iostream>
 #include <vector>
 #include <utility>
 #include <string>
 #include <atomic>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include "timer_records.h"
+#include "perf_counters.h"
+#include "tsc_clock.h"
+
+/**
+ * @brief Returns the unit suffix used when printing durations of type Tdur.
+ *        Durations without a named unit are printed as a fraction of a second, e.g. "(1/60)s".
+ */
+template <typename Tdur>
+std::string duration_unit_string(){
+    using period_t = typename Tdur::period;
+    return "(" + std::to_string(period_t::num) + "/" + std::to_string(period_t::den) + ")s";
+}
+
+template <>
+inline std::string duration_unit_string<std::chrono::nanoseconds>(){
+    return "ns";
+}
+template <>
+inline std::string duration_unit_string<std::chrono::microseconds>(){
+    return "us";
+}
+template <>
+inline std::string duration_unit_string<std::chrono::milliseconds>(){
+    return "ms";
+}
+template <>
+inline std::string duration_unit_string<std::chrono::seconds>(){
+    return "s";
+}
+template <>
+inline std::string duration_unit_string<std::chrono::minutes>(){
+    return "min";
+}
+template <>
+inline std::string duration_unit_string<std::chrono::hours>(){
+    return "h";
+}
 
-template <typename Tdur = std::chrono::milliseconds>
+/**
+ * @brief Records labelled events and reports the durations between them in Tdur units.
+ *
+ * Clock may be swapped for TscClock/TscpClock (tsc_clock.h) when the cost of
+ * reading the clock itself matters.
+ */
+template <typename Tdur = std::chrono::milliseconds, typename Clock = std::chrono::high_resolution_clock>
 class HighResolutionTimer
 {
-    using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
+    using TimePoint = typename Clock::time_point;
     using Event = std::pair<TimePoint, std::string>;
 
 public:
@@ -17,6 +69,22 @@ public:
      */
     void clear(){
         m_t.clear();
+        m_c.clear();
+    }
+
+    /**
+     * @brief Also samples hardware counters at every event() and prints them in report().
+     *        Clears any existing events.
+     *
+     * @param counters Counter group opened on the thread that calls event(), or nullptr to stop sampling.
+     * @param elementsPerSection Elements processed between consecutive events, to report misses per element (0 to skip).
+     */
+    void useCounters(PerfCounterGroup* counters, double elementsPerSection = 0){
+        clear();
+        m_counters = counters != nullptr && counters->available() ? counters : nullptr;
+        m_elements = elementsPerSection;
+        if (counters != nullptr)
+            counters->printStatus();
     }
 
     /**
@@ -28,7 +96,10 @@ public:
     void event(std::string label = "", bool enforceFence = false){
         if (enforceFence)
             std::atomic_signal_fence(std::memory_order_seq_cst);
-        m_t.push_back(std::make_pair(std::chrono::high_resolution_clock::now(), label));
+        m_t.push_back(std::make_pair(Clock::now(), label));
+        // Counters are read after the clock, so each section carries the cost of one read
+        if (m_counters != nullptr)
+            m_c.push_back(m_counters->read());
         if (enforceFence)
             std::atomic_signal_fence(std::memory_order_seq_cst);
     }
@@ -50,6 +121,8 @@ public:
     void report(){
         for (int i = 1; i < m_t.size(); ++i){
             printSection(m_t.at(i-1), m_t.at(i));
+            if (m_counters != nullptr)
+                printCounters(m_counters->delta(m_c.at(i-1), m_c.at(i)));
         }
         printTotal();
     }
@@ -69,14 +142,34 @@ public:
         return m_t;
     }
 
+    /**
+     * @brief Returns the durations between consecutive events as records, for writeTimerRecords().
+     *
+     * @param repeat Repeat index to tag the records with.
+     */
+    std::vector<TimerRecord> sections(unsigned long long repeat = 0){
+        std::vector<TimerRecord> r;
+        for (size_t i = 1; i < m_t.size(); ++i){
+            r.push_back(TimerRecord{m_t[i-1].second + " -> " + m_t[i].second,
+                                    duration(m_t[i-1].first, m_t[i].first),
+                                    duration_string(), 0, repeat});
+        }
+        return r;
+    }
+
 private:
     std::vector<Event> m_t;
+    std::vector<PerfSample> m_c; // parallel to m_t when counters are in use
+    PerfCounterGroup* m_counters = nullptr;
+    double m_elements = 0;
 
     double duration(const TimePoint& t1, const TimePoint &t2){
         using period_t = typename Tdur::period;
         return std::chrono::duration<double, period_t>(t2 - t1).count();
     }
-    std::string duration_string();
+    std::string duration_string(){
+        return duration_unit_string<Tdur>();
+    }
     void printSection(const Event& t1, const Event& t2){
         printf("%s -> %s : %f %s\n",
                t1.second.c_str(), t2.second.c_str(),
@@ -84,6 +177,22 @@ private:
                duration_string().c_str());
     }
 
+    void printCounters(const PerfDelta& d){
+        static const char* names[PerfSample::NUM_COUNTERS] = {
+            "cycles", "instructions", "L1D misses", "LLC misses", "branch misses"
+        };
+        printf("    ");
+        for (int i = 0; i < PerfSample::NUM_COUNTERS; ++i){
+            if (!d.valid[i])
+                continue;
+            printf("%s %.0f", names[i], d.values[i]);
+            if (m_elements > 0 && i >= PerfSample::L1D_MISSES)
+                printf(" (%.4f/elem)", d.values[i] / m_elements);
+            printf(", ");
+        }
+        printf("IPC %.2f\n", d.ipc());
+    }
+
     void printTotal(){
         printf("Total %f %s\n",
                duration(m_t.front().first, m_t.back().first),
@@ -91,11 +200,279 @@ private:
     }
 };
 
-template <>
-inline std::string HighResolutionTimer<std::chrono::milliseconds>::duration_string(){
-    return "ms";
-}
-template <>
-inline std::string HighResolutionTimer<std::chrono::seconds>::duration_string(){
-    return "s";
-}
+
+/**
+ * @brief Allocation-free, multi-threaded variant of HighResolutionTimer.
+ *
+ * Every recording thread claims its own preallocated ring of events the first
+ * time it calls event(), so recording never allocates, locks or contends with
+ * other threads. Labels are stored as pointers only; use string literals, or
+ * intern() a runtime string once outside the timed region and pass the result.
+ * When a thread records more than the ring capacity the oldest events are
+ * overwritten. The per-thread rings are merged when report() is called.
+ *
+ * clear(), report() and measurements() should only be called while no thread
+ * is recording.
+ */
+template <typename Tdur = std::chrono::milliseconds, typename Clock = std::chrono::high_resolution_clock>
+class RingEventTimer
+{
+    using TimePoint = typename Clock::time_point;
+
+public:
+    using Label = const char*;
+
+    struct Event
+    {
+        TimePoint t;
+        Label label;
+    };
+
+    struct ThreadEvent
+    {
+        TimePoint t;
+        Label label;
+        size_t thread; // index of the thread's ring, in order of first event()
+    };
+
+    /**
+     * @brief Constructor. All ring storage is allocated here.
+     *
+     * @param capacityPerThread Number of events kept by each thread's ring.
+     * @param maxThreads Maximum number of threads that may record; events from
+     *                   any further threads are counted as dropped.
+     */
+    RingEventTimer(size_t capacityPerThread = 4096, size_t maxThreads = 16)
+        : m_capacity(capacityPerThread), m_slots(maxThreads),
+          m_id(nextInstanceId().fetch_add(1) + 1)
+    {
+        for (auto& slot : m_slots)
+            slot.events.reset(new Event[m_capacity]);
+    }
+
+    RingEventTimer(const RingEventTimer&) = delete;
+    RingEventTimer& operator=(const RingEventTimer&) = delete;
+
+    /**
+     * @brief Returns a label pointer which remains valid for the lifetime of the timer.
+     *        This allocates, so call it before the timed region.
+     *
+     * @param label Runtime label to intern. Repeated calls return the same pointer.
+     */
+    Label intern(const std::string& label){
+        std::lock_guard<std::mutex> lock(m_internMutex);
+        for (const auto& s : m_interned)
+            if (s == label)
+                return s.c_str();
+        m_interned.push_back(label);
+        return m_interned.back().c_str();
+    }
+
+    /**
+     * @brief Clears the events/measurements from every thread's ring.
+     */
+    void clear(){
+        for (auto& slot : m_slots)
+            slot.count.store(0, std::memory_order_relaxed);
+        m_dropped.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Records a new event/measurement into the calling thread's ring.
+     *
+     * @param label Optional label for the event; must outlive the timer.
+     * @param enforceFence Adds an atomic signal fence before and after.
+     */
+    void event(Label label = "", bool enforceFence = false){
+        if (enforceFence)
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        TimePoint t = Clock::now();
+        Slot* slot = threadSlot();
+        if (slot != nullptr){
+            size_t n = slot->count.load(std::memory_order_relaxed);
+            slot->events[n % m_capacity] = Event{t, label};
+            slot->count.store(n + 1, std::memory_order_release);
+        }
+        else{
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (enforceFence)
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief Convenience method to clear() and then immediately record an event().
+     *
+     * @param label Optional label for the (first) event.
+     * @param enforceFence Adds an atomic signal fence before and after.
+     */
+    void start(Label label = "start", bool enforceFence = false){
+        clear();
+        event(label, enforceFence);
+    }
+
+    /**
+     * @brief Prints the durations between consecutive events of each thread,
+     *        followed by the total span over all threads.
+     */
+    void report(){
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_slots.size(); ++i){
+            const Slot& slot = m_slots[i];
+            if (!slot.ready.load(std::memory_order_acquire))
+                continue;
+            size_t n = slot.count.load(std::memory_order_acquire);
+            size_t first = n > m_capacity ? n - m_capacity : 0;
+            printf("Thread %zu (%zu events", i, n - first);
+            if (first > 0)
+                printf(", %zu overwritten", first);
+            printf(")\n");
+            for (size_t j = first + 1; j < n; ++j){
+                printSection(slot.events[(j-1) % m_capacity], slot.events[j % m_capacity]);
+            }
+        }
+        size_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped > 0)
+            printf("%zu events dropped (more than %zu threads)\n", dropped, m_slots.size());
+        printTotal();
+    }
+
+    /**
+     * @brief Convenience method to add a final event() and then report().
+     *
+     * @param label Optional label for the (last) event.
+     * @param enforceFence Adds an atomic signal fence before and after.
+     */
+    void stop(Label label = "end", bool enforceFence = false){
+        event(label, enforceFence);
+        report();
+    }
+
+    /**
+     * @brief Merges all retained events from every thread, sorted by time.
+     */
+    std::vector<ThreadEvent> measurements(){
+        std::vector<ThreadEvent> merged;
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_slots.size(); ++i){
+            const Slot& slot = m_slots[i];
+            if (!slot.ready.load(std::memory_order_acquire))
+                continue;
+            size_t n = slot.count.load(std::memory_order_acquire);
+            size_t first = n > m_capacity ? n - m_capacity : 0;
+            for (size_t j = first; j < n; ++j){
+                const Event& e = slot.events[j % m_capacity];
+                merged.push_back(ThreadEvent{e.t, e.label, i});
+            }
+        }
+        std::stable_sort(merged.begin(), merged.end(),
+            [](const ThreadEvent& a, const ThreadEvent& b){ return a.t < b.t; });
+        return merged;
+    }
+
+    /**
+     * @brief Returns the durations between consecutive events of each thread as records,
+     *        for writeTimerRecords().
+     *
+     * @param repeat Repeat index to tag the records with.
+     */
+    std::vector<TimerRecord> sections(unsigned long long repeat = 0){
+        std::vector<TimerRecord> r;
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_slots.size(); ++i){
+            const Slot& slot = m_slots[i];
+            if (!slot.ready.load(std::memory_order_acquire))
+                continue;
+            size_t n = slot.count.load(std::memory_order_acquire);
+            size_t first = n > m_capacity ? n - m_capacity : 0;
+            for (size_t j = first + 1; j < n; ++j){
+                const Event& t1 = slot.events[(j-1) % m_capacity];
+                const Event& t2 = slot.events[j % m_capacity];
+                r.push_back(TimerRecord{std::string(t1.label) + " -> " + t2.label,
+                                        duration(t1.t, t2.t), duration_string(), i, repeat});
+            }
+        }
+        return r;
+    }
+
+private:
+    struct Slot
+    {
+        std::unique_ptr<Event[]> events;
+        std::atomic<size_t> count{0};
+        std::atomic<bool> ready{false};
+        std::thread::id owner;
+    };
+
+    // Remembers the last timer used by this thread, so the common case is a single compare
+    struct SlotCache
+    {
+        unsigned long long timerId = 0;
+        Slot* slot = nullptr;
+    };
+
+    size_t m_capacity;
+    std::vector<Slot> m_slots;
+    std::atomic<size_t> m_numClaimed{0};
+    std::atomic<size_t> m_dropped{0};
+    unsigned long long m_id;
+
+    std::mutex m_internMutex;
+    std::deque<std::string> m_interned; // deque so that interned pointers stay valid
+
+    static std::atomic<unsigned long long>& nextInstanceId(){
+        static std::atomic<unsigned long long> id{0};
+        return id;
+    }
+
+    Slot* threadSlot(){
+        static thread_local SlotCache cache;
+        if (cache.timerId == m_id)
+            return cache.slot;
+
+        // Slow path: find this thread's ring if it already has one, otherwise claim a new one
+        std::thread::id self = std::this_thread::get_id();
+        Slot* found = nullptr;
+        size_t numThreads = m_numClaimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < numThreads && i < m_slots.size(); ++i){
+            if (m_slots[i].ready.load(std::memory_order_acquire) && m_slots[i].owner == self){
+                found = &m_slots[i];
+                break;
+            }
+        }
+        if (found == nullptr){
+            size_t idx = m_numClaimed.fetch_add(1, std::memory_order_acq_rel);
+            if (idx >= m_slots.size())
+                return nullptr; // don't cache, so that a later clear() doesn't hide the drop
+            found = &m_slots[idx];
+            found->owner = self;
+            found->ready.store(true, std::memory_order_release);
+        }
+        cache.timerId = m_id;
+        cache.slot = found;
+        return found;
+    }
+
+    double duration(const TimePoint& t1, const TimePoint &t2){
+        using period_t = typename Tdur::period;
+        return std::chrono::duration<double, period_t>(t2 - t1).count();
+    }
+    std::string duration_string(){
+        return duration_unit_string<Tdur>();
+    }
+    void printSection(const Event& t1, const Event& t2){
+        printf("%s -> %s : %f %s\n",
+               t1.label, t2.label,
+               duration(t1.t, t2.t),
+               duration_string().c_str());
+    }
+
+    void printTotal(){
+        std::vector<ThreadEvent> merged = measurements();
+        if (merged.empty())
+            return;
+        printf("Total %f %s\n",
+               duration(merged.front().t, merged.back().t),
+               duration_string().c_str());
+    }
+};
@@ -0,0 +1,140 @@
+// Compares two timer record files (written by writeTimerRecords) and flags statistically significant slowdowns.
+// Records are grouped by label; each group is compared with Welch's t-test.
+// Exits with 1 if any label got significantly slower, so it can gate a build.
+//
+// Usage: timer_compare baseline.csv current.csv [alpha=0.01] [min_slowdown=0.05]
+
+#include "timer_records.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+struct GroupStats
+{
+    std::string unit;
+    size_t n = 0;
+    double mean = 0;
+    double var = 0;
+};
+
+std::map<std::string, GroupStats> groupRecords(const std::vector<TimerRecord>& records)
+{
+    std::map<std::string, std::vector<double>> durations;
+    std::map<std::string, GroupStats> groups;
+    for (const auto& r : records){
+        durations[r.label].push_back(r.duration);
+        groups[r.label].unit = r.unit;
+    }
+    for (auto& kv : durations){
+        GroupStats& g = groups[kv.first];
+        const std::vector<double>& x = kv.second;
+        g.n = x.size();
+        for (double v : x)
+            g.mean += v;
+        g.mean /= g.n;
+        for (double v : x)
+            g.var += (v - g.mean) * (v - g.mean);
+        g.var = g.n > 1 ? g.var / (g.n - 1) : 0;
+    }
+    return groups;
+}
+
+// Continued fraction for the regularized incomplete beta function (Numerical Recipes betacf)
+double betacf(double a, double b, double x)
+{
+    const double eps = 1e-12, fpmin = 1e-300;
+    double qab = a + b, qap = a + 1, qam = a - 1;
+    double c = 1, d = 1 - qab * x / qap;
+    if (std::fabs(d) < fpmin) d = fpmin;
+    d = 1 / d;
+    double h = d;
+    for (int m = 1; m <= 300; ++m){
+        int m2 = 2 * m;
+        double aa = m * (b - m) * x / ((qam + m2) * (a + m2));
+        d = 1 + aa * d; if (std::fabs(d) < fpmin) d = fpmin;
+        c = 1 + aa / c; if (std::fabs(c) < fpmin) c = fpmin;
+        d = 1 / d;
+        h *= d * c;
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2));
+        d = 1 + aa * d; if (std::fabs(d) < fpmin) d = fpmin;
+        c = 1 + aa / c; if (std::fabs(c) < fpmin) c = fpmin;
+        d = 1 / d;
+        double del = d * c;
+        h *= del;
+        if (std::fabs(del - 1) < eps)
+            break;
+    }
+    return h;
+}
+
+double incompleteBeta(double a, double b, double x)
+{
+    if (x <= 0) return 0;
+    if (x >= 1) return 1;
+    double bt = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+        return bt * betacf(a, b, x) / a;
+    return 1 - bt * betacf(b, a, 1 - x) / b;
+}
+
+// One-sided p-value that the current mean is larger than the baseline mean
+double welchPValue(const GroupStats& base, const GroupStats& cur)
+{
+    double sb = base.var / base.n, sc = cur.var / cur.n;
+    double se = std::sqrt(sb + sc);
+    if (se == 0)
+        return cur.mean > base.mean ? 0.0 : 1.0;
+    double t = (cur.mean - base.mean) / se;
+    double df = (sb + sc) * (sb + sc) /
+                (sb * sb / std::max<size_t>(base.n - 1, 1) + sc * sc / std::max<size_t>(cur.n - 1, 1));
+    double tail = 0.5 * incompleteBeta(0.5 * df, 0.5, df / (df + t * t)); // P(T > |t|)
+    return t > 0 ? tail : 1 - tail;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3){
+        printf("Usage: %s baseline.{csv,json} current.{csv,json} [alpha=0.01] [min_slowdown=0.05]\n", argv[0]);
+        return 2;
+    }
+    double alpha = argc > 3 ? atof(argv[3]) : 0.01;
+    double minSlowdown = argc > 4 ? atof(argv[4]) : 0.05;
+
+    std::vector<TimerRecord> baseRecords = readTimerRecords(argv[1]);
+    std::vector<TimerRecord> curRecords = readTimerRecords(argv[2]);
+    if (baseRecords.empty() || curRecords.empty()){
+        printf("No records read from %s\n", baseRecords.empty() ? argv[1] : argv[2]);
+        return 2;
+    }
+    std::map<std::string, GroupStats> base = groupRecords(baseRecords);
+    std::map<std::string, GroupStats> cur = groupRecords(curRecords);
+
+    int numSlower = 0;
+    for (const auto& kv : cur){
+        auto it = base.find(kv.first);
+        if (it == base.end()){
+            printf("%-40s : new (mean %f %s)\n", kv.first.c_str(), kv.second.mean, kv.second.unit.c_str());
+            continue;
+        }
+        const GroupStats& b = it->second;
+        const GroupStats& c = kv.second;
+        if (b.unit != c.unit){
+            printf("%-40s : unit mismatch (%s vs %s), skipped\n", kv.first.c_str(), b.unit.c_str(), c.unit.c_str());
+            continue;
+        }
+        double change = b.mean > 0 ? c.mean / b.mean - 1 : 0;
+        double p = welchPValue(b, c);
+        bool slower = change > minSlowdown && p < alpha;
+        numSlower += slower;
+        printf("%-40s : %f -> %f %s (%+.1f%%, p=%.4f)%s\n",
+               kv.first.c_str(), b.mean, c.mean, c.unit.c_str(),
+               change * 100, p, slower ? "  SLOWER" : "");
+    }
+    for (const auto& kv : base){
+        if (cur.find(kv.first) == cur.end())
+            printf("%-40s : missing from %s\n", kv.first.c_str(), argv[2]);
+    }
+
+    printf("%d significant slowdown(s)\n", numSlower);
+    return numSlower > 0 ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One timed section, as written to machine-readable timer output.
+ */
+struct TimerRecord
+{
+    std::string label;
+    double duration = 0;
+    std::string unit;
+    unsigned long long thread = 0; // index of the recording thread within its timer
+    unsigned long long repeat = 0; // repeat index, when a case is run several times
+};
+
+namespace timer_records_detail
+{
+    inline bool endsWith(const std::string& s, const std::string& suffix){
+        return s.size() >= suffix.size() &&
+               s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    inline std::string escapeJson(const std::string& s){
+        std::string r;
+        for (char c : s){
+            if (c == '"' || c == '\\'){
+                r += '\\';
+                r += c;
+            }
+            else if (c == '\n')
+                r += "\\n";
+            else if (static_cast<unsigned char>(c) < 0x20){
+                // JSON doesn't allow raw control characters in strings
+                char u[7];
+                snprintf(u, sizeof(u), "\\u%04x", static_cast<unsigned char>(c));
+                r += u;
+            }
+            else
+                r += c;
+        }
+        return r;
+    }
+
+    inline std::string quoteCsv(const std::string& s){
+        std::string r = "\"";
+        for (char c : s){
+            if (c == '"')
+                r += '"';
+            r += c;
+        }
+        return r + "\"";
+    }
+
+    // Splits a single CSV line, honouring double-quoted fields
+    inline std::vector<std::string> splitCsv(const std::string& line){
+        std::vector<std::string> fields(1);
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); ++i){
+            char c = line[i];
+            if (quoted){
+                if (c == '"' && i + 1 < line.size() && line[i+1] == '"')
+                    fields.back() += line[++i];
+                else if (c == '"')
+                    quoted = false;
+                else
+                    fields.back() += c;
+            }
+            else if (c == '"')
+                quoted = true;
+            else if (c == ',')
+                fields.emplace_back();
+            else if (c != '\r')
+                fields.back() += c;
+        }
+        return fields;
+    }
+
+    // Extracts the value of "key" from a single-line JSON object written by writeTimerRecords()
+    inline bool jsonField(const std::string& line, const std::string& key, std::string& value){
+        size_t pos = line.find("\"" + key + "\":");
+        if (pos == std::string::npos)
+            return false;
+        pos += key.size() + 3;
+        while (pos < line.size() && line[pos] == ' ')
+            ++pos;
+        value.clear();
+        if (pos < line.size() && line[pos] == '"'){
+            for (++pos; pos < line.size() && line[pos] != '"'; ++pos){
+                if (line[pos] == '\\' && pos + 1 < line.size()){
+                    ++pos;
+                    if (line[pos] == 'u' && pos + 4 < line.size()){
+                        // only the \u00XX control characters that escapeJson() writes are expected
+                        value += static_cast<char>(std::strtol(line.substr(pos + 1, 4).c_str(), nullptr, 16));
+                        pos += 4;
+                    }
+                    else
+                        value += line[pos] == 'n' ? '\n' : line[pos] == 't' ? '\t' : line[pos] == 'r' ? '\r' : line[pos];
+                }
+                else
+                    value += line[pos];
+            }
+        }
+        else{
+            while (pos < line.size() && line[pos] != ',' && line[pos] != '}')
+                value += line[pos++];
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief Writes records to a file, as JSON if the path ends in .json and as CSV otherwise.
+ *
+ * @param path Output file path; it is overwritten.
+ * @param records Records to write.
+ * @return True if the file was written.
+ */
+inline bool writeTimerRecords(const std::string& path, const std::vector<TimerRecord>& records)
+{
+    using namespace timer_records_detail;
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL)
+        return false;
+
+    if (endsWith(path, ".json")){
+        fprintf(fp, "[\n");
+        for (size_t i = 0; i < records.size(); ++i){
+            const TimerRecord& r = records[i];
+            fprintf(fp, "{\"label\": \"%s\", \"duration\": %.9g, \"unit\": \"%s\", \"thread\": %llu, \"repeat\": %llu}%s\n",
+                    escapeJson(r.label).c_str(), r.duration, escapeJson(r.unit).c_str(),
+                    r.thread, r.repeat, i + 1 < records.size() ? "," : "");
+        }
+        fprintf(fp, "]\n");
+    }
+    else{
+        fprintf(fp, "label,duration,unit,thread,repeat\n");
+        for (const TimerRecord& r : records){
+            fprintf(fp, "%s,%.9g,%s,%llu,%llu\n",
+                    quoteCsv(r.label).c_str(), r.duration, r.unit.c_str(), r.thread, r.repeat);
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+/**
+ * @brief Reads records previously written by writeTimerRecords().
+ *
+ * @param path Input file path; JSON if it ends in .json, CSV otherwise.
+ * @return The records, empty if the file could not be read.
+ */
+inline std::vector<TimerRecord> readTimerRecords(const std::string& path)
+{
+    using namespace timer_records_detail;
+    std::vector<TimerRecord> records;
+    std::ifstream in(path);
+    std::string line;
+    bool json = endsWith(path, ".json");
+    bool header = !json;
+
+    while (std::getline(in, line)){
+        if (header){
+            header = false;
+            continue;
+        }
+        TimerRecord r;
+        if (json){
+            std::string duration, thread, repeat;
+            if (!jsonField(line, "label", r.label) || !jsonField(line, "duration", duration))
+                continue;
+            jsonField(line, "unit", r.unit);
+            if (jsonField(line, "thread", thread))
+                r.thread = std::strtoull(thread.c_str(), nullptr, 10);
+            if (jsonField(line, "repeat", repeat))
+                r.repeat = std::strtoull(repeat.c_str(), nullptr, 10);
+            r.duration = std::strtod(duration.c_str(), nullptr);
+        }
+        else{
+            std::vector<std::string> fields = splitCsv(line);
+            if (fields.size() < 5)
+                continue;
+            r.label = fields[0];
+            r.duration = std::strtod(fields[1].c_str(), nullptr);
+            r.unit = fields[2];
+            r.thread = std::strtoull(fields[3].c_str(), nullptr, 10);
+            r.repeat = std::strtoull(fields[4].c_str(), nullptr, 10);
+        }
+        records.push_back(r);
+    }
+    return records;
+}
@@ -1,4 +1,5 @@
 #include "timer.h"
+#include "profile_zones.h"
 #include <thread>
 
 
@@ -24,6 +25,83 @@ int main(){
         std::this_thread::sleep_for(200ms);
         timer.stop("end after sleep again");
     }
+    {
+        // Cheap TSC-based clock for short sections, at nanosecond resolution
+        TscClock::calibrate();
+        printf("Invariant TSC: %s, %.3f GHz\n", TscClock::invariant() ? "yes" : "no", TscClock::frequency() / 1e9);
+        HighResolutionTimer<std::chrono::nanoseconds, TscClock> timer;
+
+        timer.start("custom start");
+        timer.event("back to back");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        timer.stop("after 100us sleep");
+    }
+    {
+        HighResolutionTimer<std::chrono::microseconds> timer;
+
+        timer.start("custom start");
+        std::this_thread::sleep_for(100us);
+        timer.stop("after 100us sleep");
+    }
+    {
+        // Hardware counters, if this machine/user permits them
+        PerfCounterGroup counters;
+        HighResolutionTimer<> timer;
+        const size_t len = 1 << 20;
+        std::vector<float> x(len, 1.0f);
+        timer.useCounters(&counters, (double)len);
+
+        timer.start("custom start");
+        float sum = 0;
+        for (size_t i = 0; i < len; ++i)
+            sum += x[i];
+        timer.event("after sequential sum");
+        for (size_t i = 0; i < len; ++i)
+            sum += x[(i * 4099) % len];
+        timer.stop("after strided sum");
+        printf("Sum %f\n", sum);
+    }
+    {
+        RingEventTimer<> timer(8);
+        RingEventTimer<>::Label workerLabel = timer.intern(std::string("worker ") + "done");
+
+        timer.start("custom start");
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 3; ++i){
+            workers.emplace_back([&timer, workerLabel, i](){
+                timer.event("worker start");
+                std::this_thread::sleep_for(std::chrono::milliseconds(50 * (i+1)));
+                timer.event(workerLabel);
+            });
+        }
+        for (auto& worker : workers)
+            worker.join();
+        timer.stop("end after workers");
+    }
+    {
+        ZoneProfiler<std::chrono::microseconds> profiler(4, 64);
+        auto work = [&profiler](int loops){
+            ProfileZone<std::chrono::microseconds> outer(profiler, "recv_to_file");
+            for (int i = 0; i < loops; ++i){
+                {
+                    ProfileZone<std::chrono::microseconds> recv(profiler, "recv");
+                    std::this_thread::sleep_for(1ms);
+                }
+                ProfileZone<std::chrono::microseconds> save(profiler, "save_to_file");
+                ProfileZone<std::chrono::microseconds> write(profiler, "fwrite");
+                std::this_thread::sleep_for(2ms);
+            }
+        };
+        std::thread other(work, 3);
+        work(5);
+        other.join();
+        profiler.report();
+        profiler.writeChromeTrace("timer_test_trace.json");
+
+        profiler.reset();
+        work(1);
+        profiler.report();
+    }
 
     return 0;
 }
@@ -9,7 +9,7 @@
 #include "ipp.h"
 #include "ipp_ext.h"
 
-#include "timer.h"
+#include "benchmark.h"
 
 /*
 This function rotates the QPSK gray-coded bits in a counter-clockwise fashion.
@@ -210,15 +210,19 @@ int main(int argc, char *argv[])
         else{printf("IPP Error.\n");}
     }
 
+    BenchmarkHarness<> bench;
+    BenchmarkOptions opts;
+    opts.maxRepeats = 20;
+
     {
         // 8-bit speed is slower than the 32-bit and 64-bit versions, even for total number of bits being equal
         const size_t length = 40000000;
         printf("Length %zd 8-bit array.\n", length);
         std::vector<uint8_t> bits(length); 
         std::vector<uint8_t> out(length);
-        HighResolutionTimer timer;
-        gray_qpsk_rotate(bits.data(), out.data(), length);
-
+        opts.elements = (double)length;
+        opts.bytes = 2.0 * length * sizeof(uint8_t);
+        bench.run("gray_qpsk_rotate", [&](){ gray_qpsk_rotate(bits.data(), out.data(), length); }, opts).print();
     }
 
     
@@ -228,8 +232,9 @@ int main(int argc, char *argv[])
         printf("Length %zd 8-bit Ipp array.\n", length);
         ippe::vector<Ipp8u> bits(length); 
         ippe::vector<Ipp8u> out(length);
-        HighResolutionTimer timer;
-        gray_qpsk_rotate_Ipp8u(bits.data(), out.data(), length);
+        opts.elements = (double)length;
+        opts.bytes = 2.0 * length * sizeof(Ipp8u);
+        bench.run("gray_qpsk_rotate_Ipp8u", [&](){ gray_qpsk_rotate_Ipp8u(bits.data(), out.data(), length); }, opts).print();
     }
 
     {
@@ -237,9 +242,9 @@ int main(int argc, char *argv[])
         printf("Length %zd 32-bit array.\n", length);
         std::vector<uint32_t> bits(length); 
         std::vector<uint32_t> out(length);
-        HighResolutionTimer timer;
-        gray_qpsk_rotate32(bits.data(), out.data(), length);
-
+        opts.elements = (double)length;
+        opts.bytes = 2.0 * length * sizeof(uint32_t);
+        bench.run("gray_qpsk_rotate32", [&](){ gray_qpsk_rotate32(bits.data(), out.data(), length); }, opts).print();
     }
 
     
@@ -251,8 +256,9 @@ int main(int argc, char *argv[])
         printf("Length %zd 64-bit array.\n", length);
         std::vector<uint64_t> bits(length); 
         std::vector<uint64_t> out(length);
-        HighResolutionTimer timer;
-        gray_qpsk_rotate64(bits.data(), out.data(), length);
+        opts.elements = (double)length;
+        opts.bytes = 2.0 * length * sizeof(uint64_t);
+        bench.run("gray_qpsk_rotate64", [&](){ gray_qpsk_rotate64(bits.data(), out.data(), length); }, opts).print();
     }
     
 
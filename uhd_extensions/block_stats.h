@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BLOCK_STATS_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+Statistics of one block of samples, gathered in a single pass over squared magnitudes,
+so there is no sqrt per sample and no promotion of every sample to double.
+*/
+struct BlockStats
+{
+    double maxPower = 0;       // largest |x|^2
+    double meanPower = 0;      // mean |x|^2 over the samples scanned
+    size_t saturated = 0;      // samples with |x| above the saturation level
+    size_t scanned = 0;        // less than the block length if the scan stopped early
+    bool aboveThreshold = false;
+
+    double maxMagnitude() const { return std::sqrt(maxPower); }
+};
+
+namespace block_stats_detail
+{
+    const size_t CHUNK = 4096; // samples between early-exit checks
+
+    template <typename T> inline double power(const T &x) { return static_cast<double>(x) * x; }
+    template <typename T> inline double power(const std::complex<T> &x)
+    {
+        double re = x.real(), im = x.imag();
+        return re * re + im * im;
+    }
+
+    // running totals for one chunk at a time
+    struct Totals
+    {
+        double maxPower = 0;
+        double sum = 0;
+        size_t above = 0;
+        size_t saturated = 0;
+    };
+
+    // plain loop for any sample type; thresholds are squared, and 'infinite' when disabled
+    template <typename samp_type>
+    void scanScalar(const samp_type *x, size_t n, double thresholdSq, double saturationSq, Totals &t)
+    {
+        for (size_t i = 0; i < n; i++){
+            double p = power(x[i]);
+            t.sum += p;
+            t.maxPower = p > t.maxPower ? p : t.maxPower;
+            t.above += p > thresholdSq;
+            t.saturated += p > saturationSq;
+        }
+    }
+
+#ifdef BLOCK_STATS_AVX2
+    inline bool haveAvx2()
+    {
+        static const bool r = __builtin_cpu_supports("avx2");
+        return r;
+    }
+
+    // largest uint32 strictly below which a squared magnitude does not exceed limit
+    inline uint32_t integerLimit(double limitSq)
+    {
+        return limitSq >= 4294967295.0 ? 0xFFFFFFFFu : static_cast<uint32_t>(limitSq);
+    }
+
+    // sc16: madd gives re^2 + im^2 of 8 samples exactly, as unsigned 32-bit values (at most 2^31)
+    __attribute__((target("avx2")))
+    inline void scanAvx2(const std::complex<short> *x, size_t n, double thresholdSq, double saturationSq, Totals &t)
+    {
+        const __m256i flip = _mm256_set1_epi32((int)0x80000000u); // for unsigned compares
+        const __m256i thr = _mm256_xor_si256(_mm256_set1_epi32((int)integerLimit(thresholdSq)), flip);
+        const __m256i sat = _mm256_xor_si256(_mm256_set1_epi32((int)integerLimit(saturationSq)), flip);
+        __m256i vmax = _mm256_setzero_si256();
+        __m256i vsum = _mm256_setzero_si256(); // 4 x 64-bit
+        size_t above = 0, saturated = 0;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8){
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+            __m256i p = _mm256_madd_epi16(v, v);
+            vmax = _mm256_max_epu32(vmax, p);
+            vsum = _mm256_add_epi64(vsum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(p)));
+            vsum = _mm256_add_epi64(vsum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(p, 1)));
+            __m256i pf = _mm256_xor_si256(p, flip);
+            above += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(pf, thr))));
+            saturated += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(pf, sat))));
+        }
+        alignas(32) uint32_t m[8];
+        alignas(32) uint64_t s[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(m), vmax);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(s), vsum);
+        uint32_t mx = *std::max_element(m, m + 8);
+        t.maxPower = std::max(t.maxPower, static_cast<double>(mx));
+        t.sum += static_cast<double>(s[0] + s[1] + s[2] + s[3]);
+        t.above += above;
+        t.saturated += saturated;
+        // only the integer thresholds' truncation could differ from the scalar comparison, and it doesn't for integer powers
+        scanScalar(x + i, n - i, thresholdSq, saturationSq, t);
+    }
+
+    // fc32: squares of interleaved re/im, then horizontal adds pair them up (in a shuffled, but irrelevant, order)
+    __attribute__((target("avx2")))
+    inline void scanAvx2(const std::complex<float> *x, size_t n, double thresholdSq, double saturationSq, Totals &t)
+    {
+        const __m256 thr = _mm256_set1_ps(static_cast<float>(std::min(thresholdSq, 3.0e38)));
+        const __m256 sat = _mm256_set1_ps(static_cast<float>(std::min(saturationSq, 3.0e38)));
+        const float *f = reinterpret_cast<const float*>(x);
+        __m256 vmax = _mm256_setzero_ps();
+        __m256d vsum = _mm256_setzero_pd();
+        size_t above = 0, saturated = 0;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8){
+            __m256 a = _mm256_loadu_ps(f + 2 * i);
+            __m256 b = _mm256_loadu_ps(f + 2 * i + 8);
+            __m256 p = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+            vmax = _mm256_max_ps(vmax, p);
+            vsum = _mm256_add_pd(vsum, _mm256_cvtps_pd(_mm256_castps256_ps128(p)));
+            vsum = _mm256_add_pd(vsum, _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1)));
+            above += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(p, thr, _CMP_GT_OQ)));
+            saturated += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(p, sat, _CMP_GT_OQ)));
+        }
+        alignas(32) float m[8];
+        alignas(32) double s[4];
+        _mm256_store_ps(m, vmax);
+        _mm256_store_pd(s, vsum);
+        t.maxPower = std::max(t.maxPower, static_cast<double>(*std::max_element(m, m + 8)));
+        t.sum += s[0] + s[1] + s[2] + s[3];
+        t.above += above;
+        t.saturated += saturated;
+        scanScalar(x + i, n - i, thresholdSq, saturationSq, t);
+    }
+
+    // fc64: as fc32, four samples at a time
+    __attribute__((target("avx2")))
+    inline void scanAvx2(const std::complex<double> *x, size_t n, double thresholdSq, double saturationSq, Totals &t)
+    {
+        const __m256d thr = _mm256_set1_pd(thresholdSq);
+        const __m256d sat = _mm256_set1_pd(saturationSq);
+        const double *d = reinterpret_cast<const double*>(x);
+        __m256d vmax = _mm256_setzero_pd();
+        __m256d vsum = _mm256_setzero_pd();
+        size_t above = 0, saturated = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4){
+            __m256d a = _mm256_loadu_pd(d + 2 * i);
+            __m256d b = _mm256_loadu_pd(d + 2 * i + 4);
+            __m256d p = _mm256_hadd_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b));
+            vmax = _mm256_max_pd(vmax, p);
+            vsum = _mm256_add_pd(vsum, p);
+            above += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(p, thr, _CMP_GT_OQ)));
+            saturated += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(p, sat, _CMP_GT_OQ)));
+        }
+        alignas(32) double m[4];
+        alignas(32) double s[4];
+        _mm256_store_pd(m, vmax);
+        _mm256_store_pd(s, vsum);
+        t.maxPower = std::max(t.maxPower, *std::max_element(m, m + 4));
+        t.sum += s[0] + s[1] + s[2] + s[3];
+        t.above += above;
+        t.saturated += saturated;
+        scanScalar(x + i, n - i, thresholdSq, saturationSq, t);
+    }
+#endif
+
+    template <typename samp_type>
+    struct HasVectorScan : std::integral_constant<bool,
+        std::is_same<samp_type, std::complex<short>>::value || std::is_same<samp_type, std::complex<float>>::value
+        || std::is_same<samp_type, std::complex<double>>::value> {};
+
+    template <typename samp_type>
+    typename std::enable_if<HasVectorScan<samp_type>::value>::type
+    scanChunk(const samp_type *x, size_t n, double thresholdSq, double saturationSq, Totals &t)
+    {
+#ifdef BLOCK_STATS_AVX2
+        if (haveAvx2())
+            return scanAvx2(x, n, thresholdSq, saturationSq, t);
+#endif
+        scanScalar(x, n, thresholdSq, saturationSq, t);
+    }
+
+    template <typename samp_type>
+    typename std::enable_if<!HasVectorScan<samp_type>::value>::type
+    scanChunk(const samp_type *x, size_t n, double thresholdSq, double saturationSq, Totals &t)
+    {
+        scanScalar(x, n, thresholdSq, saturationSq, t);
+    }
+}
+
+/*
+Computes max |x|^2, mean |x|^2 and the number of samples with |x| > saturation in one pass,
+and whether any sample has |x| > threshold. A threshold or saturation level <= 0 is not checked.
+sc16, fc32 and fc64 use AVX2 when the CPU has it (chosen at run time, so no -mavx2 is needed).
+
+With stopEarly, the scan ends at the first chunk where every enabled check has already been met,
+so maxPower/meanPower then only describe the samples scanned.
+*/
+template <typename samp_type>
+BlockStats scanBlock(const samp_type *x, size_t n, double threshold, double saturation, bool stopEarly = false)
+{
+    using namespace block_stats_detail;
+    const double inf = HUGE_VAL;
+    double thresholdSq = threshold > 0 ? threshold * threshold : inf;
+    double saturationSq = saturation > 0 ? saturation * saturation : inf;
+
+    BlockStats r;
+    if (stopEarly && threshold <= 0 && saturation <= 0)
+        return r;
+
+    Totals t;
+    size_t i = 0;
+    while (i < n){
+        size_t len = std::min(CHUNK, n - i);
+        scanChunk(x + i, len, thresholdSq, saturationSq, t);
+        i += len;
+        if (stopEarly && (threshold <= 0 || t.above > 0) && (saturation <= 0 || t.saturated > 0))
+            break;
+    }
+
+    r.maxPower = t.maxPower;
+    r.meanPower = i > 0 ? t.sum / i : 0;
+    r.saturated = t.saturated;
+    r.scanned = i;
+    r.aboveThreshold = t.above > 0;
+    return r;
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "sample_ring.h"
+
+/*
+Backend used by the recorder's writer threads to put one block into one new file.
+write() may be called from several threads at once.
+*/
+class BlockWriter
+{
+public:
+    virtual ~BlockWriter() {}
+
+    // returns false (after printing why) if the file could not be written completely
+    virtual bool write(const char *path, const void *data, size_t bytes) = 0;
+    virtual const char* name() const = 0;
+};
+
+// buffered fopen/fwrite/fclose, as the recorder always did
+class StdioBlockWriter : public BlockWriter
+{
+public:
+    bool write(const char *path, const void *data, size_t bytes) override
+    {
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL){
+            printf("Failed to open %s : %s\n", path, strerror(errno));
+            return false;
+        }
+        size_t written = fwrite(data, 1, bytes, fp);
+        bool ok = fclose(fp) == 0 && written == bytes;
+        if (!ok)
+            printf("Failed to write %s : %s\n", path, strerror(errno));
+        return ok;
+    }
+
+    const char* name() const override { return "stdio"; }
+};
+
+#ifdef __linux__
+
+namespace block_writer_detail
+{
+    const size_t DIRECT_ALIGN = 4096; // covers the logical block size of any current drive
+
+    // opens for O_DIRECT writing and reserves the file's extents up front; falls back to buffered
+    // writes on filesystems without O_DIRECT (e.g. tmpfs)
+    inline int openPreallocated(const char *path, size_t bytes, bool &direct)
+    {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        direct = fd >= 0;
+        if (fd < 0 && errno == EINVAL)
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0){
+            printf("Failed to open %s : %s\n", path, strerror(errno));
+            return -1;
+        }
+        if (bytes > 0 && fallocate(fd, 0, 0, (off_t)bytes) != 0 && errno != EOPNOTSUPP)
+            printf("Failed to preallocate %s : %s\n", path, strerror(errno));
+        return fd;
+    }
+
+    inline bool pwriteAll(int fd, const char *data, size_t bytes, off_t offset)
+    {
+        while (bytes > 0){
+            ssize_t n = pwrite(fd, data, bytes, offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            bytes -= n;
+            offset += n;
+        }
+        return true;
+    }
+
+    // writes the unaligned remainder of a block, which O_DIRECT would reject
+    inline bool writeTail(int fd, bool direct, const char *data, size_t bytes, off_t offset)
+    {
+        if (bytes == 0)
+            return true;
+        if (direct)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        return pwriteAll(fd, data, bytes, offset);
+    }
+}
+
+/*
+Writes straight from the sample ring to the drive with O_DIRECT, bypassing the page cache,
+into files preallocated with fallocate. Memory use stays flat and there are no writeback bursts.
+The data must be 4096-byte aligned, as SampleRing blocks are; anything else is written buffered.
+*/
+class DirectBlockWriter : public BlockWriter
+{
+public:
+    bool write(const char *path, const void *data, size_t bytes) override
+    {
+        using namespace block_writer_detail;
+        bool direct;
+        int fd = openPreallocated(path, bytes, direct);
+        if (fd < 0)
+            return false;
+        if (direct && reinterpret_cast<uintptr_t>(data) % DIRECT_ALIGN != 0){
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+        }
+
+        const char *p = static_cast<const char*>(data);
+        size_t aligned = direct ? bytes / DIRECT_ALIGN * DIRECT_ALIGN : bytes;
+        bool ok = pwriteAll(fd, p, aligned, 0) && writeTail(fd, direct, p + aligned, bytes - aligned, (off_t)aligned);
+        if (!ok)
+            printf("Failed to write %s : %s\n", path, strerror(errno));
+        return close(fd) == 0 && ok;
+    }
+
+    const char* name() const override { return "direct"; }
+};
+
+/*
+Writes with io_uring: each block is split into chunks which are all queued at once, so the drive
+sees a deep queue even from a single writer thread. Files are opened O_DIRECT and preallocated as above.
+
+The ring's memory is registered with each io_uring instance, so the kernel doesn't have to pin and
+map the pages on every write. Each writer thread gets its own instance on first use.
+Uses the raw system calls, so there is no liburing dependency.
+*/
+class UringBlockWriter : public BlockWriter
+{
+public:
+    // registered may be null, in which case plain (unregistered) writes are used
+    UringBlockWriter(const AlignedRegion *registered = nullptr, unsigned queueDepth = 32, size_t chunkBytes = 1 << 20)
+        : m_registered(registered), m_queueDepth(queueDepth), m_chunkBytes(chunkBytes),
+          m_id(nextInstanceId().fetch_add(1) + 1)
+    {
+    }
+
+    bool write(const char *path, const void *data, size_t bytes) override
+    {
+        using namespace block_writer_detail;
+        Queue *q = queue();
+        if (q == nullptr || !q->ok())
+            return m_fallback.write(path, data, bytes);
+
+        bool direct;
+        int fd = openPreallocated(path, bytes, direct);
+        if (fd < 0)
+            return false;
+        if (direct && reinterpret_cast<uintptr_t>(data) % DIRECT_ALIGN != 0){
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+        }
+
+        const char *p = static_cast<const char*>(data);
+        size_t aligned = direct ? bytes / DIRECT_ALIGN * DIRECT_ALIGN : bytes;
+        bool ok = q->writeAll(fd, p, aligned, m_chunkBytes) && writeTail(fd, direct, p + aligned, bytes - aligned, (off_t)aligned);
+        if (!ok)
+            printf("Failed to write %s : %s\n", path, strerror(errno));
+        return close(fd) == 0 && ok;
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+private:
+    static const size_t MAX_IOVEC = 1 << 30; // registered buffers are limited to 1 GiB each
+    static const int MAX_ENTER_RETRIES = 10000; // EINTR/EAGAIN/EBUSY in a row before the queue is given up on
+
+    class Queue
+    {
+    public:
+        Queue(unsigned entries, const AlignedRegion *registered)
+        {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+            if (m_fd < 0)
+                return;
+
+            size_t sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            size_t cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                sqBytes = cqBytes = sqBytes > cqBytes ? sqBytes : cqBytes;
+            m_sqMap = mmap(nullptr, sqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+            m_sqMapBytes = sqBytes;
+            if (params.features & IORING_FEAT_SINGLE_MMAP){
+                m_cqMap = m_sqMap;
+            }
+            else{
+                m_cqMap = mmap(nullptr, cqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+                m_cqMapBytes = cqBytes;
+            }
+            m_sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+            m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+            if (m_sqMap == MAP_FAILED || m_cqMap == MAP_FAILED || m_sqes == MAP_FAILED){
+                // unmap whichever of the rings did map
+                if (m_sqes != MAP_FAILED)
+                    munmap(m_sqes, m_sqeBytes);
+                if (m_cqMap != MAP_FAILED && m_cqMap != m_sqMap)
+                    munmap(m_cqMap, m_cqMapBytes);
+                if (m_sqMap != MAP_FAILED)
+                    munmap(m_sqMap, m_sqMapBytes);
+                close(m_fd);
+                m_fd = -1;
+                return;
+            }
+
+            char *sq = static_cast<char*>(m_sqMap);
+            m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            char *cq = static_cast<char*>(m_cqMap);
+            m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            m_entries = params.sq_entries;
+
+            if (registered != nullptr){
+                std::vector<iovec> iovs;
+                for (size_t off = 0; off < registered->size(); off += MAX_IOVEC){
+                    size_t len = registered->size() - off < MAX_IOVEC ? registered->size() - off : MAX_IOVEC;
+                    iovs.push_back(iovec{static_cast<char*>(registered->data()) + off, len});
+                }
+                if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, iovs.data(), (unsigned)iovs.size()) == 0)
+                    m_registered = registered;
+                else
+                    printf("io_uring buffer registration failed (%s); using unregistered writes\n", strerror(errno));
+            }
+        }
+
+        ~Queue()
+        {
+            if (m_fd < 0)
+                return;
+            munmap(m_sqes, m_sqeBytes);
+            if (m_cqMap != m_sqMap)
+                munmap(m_cqMap, m_cqMapBytes);
+            munmap(m_sqMap, m_sqMapBytes);
+            close(m_fd);
+        }
+
+        bool ok() const { return m_fd >= 0 && !m_broken; }
+
+        // writes [data, data + bytes) at offset 0 of fd, keeping up to the queue depth of chunks in flight;
+        // only returns once the kernel is done with every chunk, so the memory can be reused straight away
+        bool writeAll(int fd, const char *data, size_t bytes, size_t chunkBytes)
+        {
+            size_t queued = 0;     // bytes prepared so far
+            unsigned prepared = 0; // in the submission queue but not yet submitted
+            unsigned inFlight = 0; // submitted but not yet completed
+            bool ok = true;
+            bool busy = false;     // the kernel refused the last submission for lack of resources
+            int retries = 0;       // consecutive io_uring_enter calls that failed transiently
+            while ((ok && queued < bytes) || prepared > 0 || inFlight > 0)
+            {
+                while (ok && queued < bytes && inFlight + prepared < m_entries){
+                    size_t len = bytes - queued < chunkBytes ? bytes - queued : chunkBytes;
+                    prepare(fd, data + queued, len, queued);
+                    queued += len;
+                    prepared++;
+                }
+                // submit whatever was prepared, and wait for at least one completion;
+                // while the kernel is busy, only wait, as completions are what free its resources
+                unsigned submit = busy && inFlight > 0 ? 0 : prepared;
+                int r = (int)syscall(__NR_io_uring_enter, m_fd, submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (r >= 0){
+                    busy = false;
+                    retries = 0;
+                    inFlight += r;
+                    prepared -= r;
+                }
+                else{
+                    int err = errno;
+                    bool transient = err == EINTR || err == EAGAIN || err == EBUSY;
+                    if (!transient){
+                        // entries may be left in the queue, so this instance can't be trusted with another write
+                        m_broken = true;
+                        if (inFlight == 0)
+                            return false;
+                        ok = false;
+                        prepared = 0;
+                    }
+                    // bounded, so a ring that never recovers can't hang the writer thread
+                    if (++retries > MAX_ENTER_RETRIES){
+                        m_broken = true;
+                        printf("io_uring_enter failed %d times in a row (%s), abandoning %u writes in flight\n",
+                               retries, strerror(err), inFlight);
+                        errno = err;
+                        return false;
+                    }
+                    busy = err == EAGAIN || err == EBUSY;
+                    if (busy && inFlight == 0)
+                        usleep(100); // nothing to wait on, so back off before submitting again
+                    errno = err;
+                }
+
+                unsigned head = *m_cqHead;
+                unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++){
+                    const io_uring_cqe &cqe = m_cqes[head & m_cqMask];
+                    Chunk c = m_chunks[cqe.user_data];
+                    m_freeChunks.push_back((unsigned)cqe.user_data);
+                    inFlight--;
+                    if (cqe.res < 0){
+                        errno = -cqe.res;
+                        ok = false;
+                    }
+                    else if ((size_t)cqe.res < c.bytes && ok && !m_broken){
+                        // short write; queue the rest again
+                        prepare(fd, c.data + cqe.res, c.bytes - cqe.res, c.offset + cqe.res);
+                        prepared++;
+                    }
+                }
+                __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            }
+            return ok;
+        }
+
+    private:
+        struct Chunk
+        {
+            const char *data;
+            size_t bytes;
+            size_t offset;
+        };
+
+        int m_fd = -1;
+        void *m_sqMap = MAP_FAILED;
+        void *m_cqMap = MAP_FAILED;
+        size_t m_sqMapBytes = 0, m_cqMapBytes = 0, m_sqeBytes = 0;
+        io_uring_sqe *m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        unsigned *m_sqHead = nullptr, *m_sqTail = nullptr, *m_sqArray = nullptr;
+        unsigned *m_cqHead = nullptr, *m_cqTail = nullptr;
+        unsigned m_sqMask = 0, m_cqMask = 0, m_entries = 0;
+        io_uring_cqe *m_cqes = nullptr;
+        const AlignedRegion *m_registered = nullptr;
+        std::vector<Chunk> m_chunks; // indexed by user_data
+        std::vector<unsigned> m_freeChunks;
+        bool m_broken = false;
+
+        // there are never more than m_entries chunks prepared or in flight, so a free one always exists
+        void prepare(int fd, const char *data, size_t bytes, size_t offset)
+        {
+            if (m_chunks.empty()){
+                m_chunks.resize(m_entries);
+                for (unsigned i = 0; i < m_entries; i++)
+                    m_freeChunks.push_back(m_entries - 1 - i);
+            }
+            unsigned slot = m_freeChunks.back();
+            m_freeChunks.pop_back();
+            m_chunks[slot] = Chunk{data, bytes, offset};
+
+            unsigned tail = *m_sqTail;
+            unsigned idx = tail & m_sqMask;
+            io_uring_sqe &sqe = m_sqes[idx];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.fd = fd;
+            sqe.off = offset;
+            sqe.addr = reinterpret_cast<uint64_t>(data);
+            sqe.len = (unsigned)bytes;
+            sqe.user_data = slot;
+            sqe.opcode = IORING_OP_WRITE;
+            if (m_registered != nullptr){
+                // compared as addresses, since data need not point into the registered region at all
+                uintptr_t base = reinterpret_cast<uintptr_t>(m_registered->data());
+                uintptr_t addr = reinterpret_cast<uintptr_t>(data);
+                size_t regOffset = addr - base;
+                if (addr >= base && regOffset + bytes <= m_registered->size()
+                    && regOffset / MAX_IOVEC == (regOffset + bytes - 1) / MAX_IOVEC){
+                    sqe.opcode = IORING_OP_WRITE_FIXED;
+                    sqe.buf_index = (uint16_t)(regOffset / MAX_IOVEC);
+                }
+            }
+            m_sqArray[idx] = idx;
+            __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        }
+    };
+
+    struct QueueCache
+    {
+        unsigned long long writerId = 0;
+        Queue *queue = nullptr;
+    };
+
+    const AlignedRegion *m_registered;
+    unsigned m_queueDepth;
+    size_t m_chunkBytes;
+    unsigned long long m_id;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    StdioBlockWriter m_fallback;
+    bool m_warned = false;
+
+    static std::atomic<unsigned long long>& nextInstanceId()
+    {
+        static std::atomic<unsigned long long> id{0};
+        return id;
+    }
+
+    // this thread's io_uring instance, or null if io_uring is unavailable
+    Queue* queue()
+    {
+        static thread_local QueueCache cache;
+        if (cache.writerId == m_id)
+            return cache.queue;
+
+        std::unique_ptr<Queue> q(new Queue(m_queueDepth, m_registered));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Queue *r = nullptr;
+        if (q->ok()){
+            r = q.get();
+            m_queues.push_back(std::move(q));
+        }
+        else if (!m_warned){
+            printf("io_uring unavailable (%s); writing with stdio instead\n", strerror(errno));
+            m_warned = true;
+        }
+        cache.writerId = m_id;
+        cache.queue = r;
+        return r;
+    }
+};
+
+#endif
+
+// kind is "stdio", "direct" or "io_uring"; registered is the memory io_uring may pre-register
+inline std::unique_ptr<BlockWriter> makeBlockWriter(const std::string &kind, const AlignedRegion *registered = nullptr)
+{
+#ifdef __linux__
+    if (kind == "direct")
+        return std::unique_ptr<BlockWriter>(new DirectBlockWriter());
+    if (kind == "io_uring" || kind == "uring")
+        return std::unique_ptr<BlockWriter>(new UringBlockWriter(registered));
+#else
+    if (kind != "stdio")
+        printf("Writer backend %s is only available on Linux; using stdio\n", kind.c_str());
+#endif
+    return std::unique_ptr<BlockWriter>(new StdioBlockWriter());
+}
@@ -0,0 +1,568 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../profile_zones.h"
+#include "writer_pool.h"
+#include "sample_ring.h"
+#include "block_writer.h"
+#include "capture_file.h"
+#include "block_stats.h"
+#include "sample_source.h"
+#include "spsc_ring.h"
+#include "thread_placement.h"
+
+/*
+The recording pipeline of rx_samples_to_file_buffered: receives into a ring of blocks and hands every
+full block to the writer pool, as one file per block per channel or into segmented capture files.
+It only sees a SampleSource, so it runs the same against a USRP or an emulated source (see recorder_bench.cpp).
+*/
+
+#ifdef __linux__
+const char pathsplit = '/';
+#else
+const char pathsplit = '\\';
+#endif
+
+static bool stop_signal_called = false;
+static ZoneProfiler<> zone_profiler; // always on; printed with --profile
+static void sig_int_handler(int)
+{
+    stop_signal_called = true;
+}
+
+struct RecorderOptions
+{
+    std::string cpu_format = "sc16";
+    size_t samps_per_buff = 10000;
+    unsigned long long num_requested_samples = 0;
+    double threshold = 0;
+    double saturation_warning = 0;
+    double time_requested = 0.0;
+    bool bw_summary = false;
+    bool stats = false;
+    bool null = false;              // receive only, nothing is written
+    bool enable_size_map = false;
+    bool verbose = false;
+    bool profile = false;
+    size_t num_writers = 0;         // 0 for one per channel
+    size_t ring_depth = 2;
+    int block_ms = 1000;
+    std::string writer_backend = "stdio";
+    std::string capture_base;       // empty for a file per block
+    double segment_seconds = 3600;
+    bool recover = false;           // fill overflows in from the metadata timestamps and carry on, instead of stopping
+    std::string gap_log;            // where recovered gaps are listed (none if empty)
+    double max_gap_seconds = 10;    // longer gaps are taken as bad timestamps, and end the recording
+    // core lists (see thread_placement.h), empty to leave a thread where the OS puts it
+    std::string rx_cpus;            // the thread calling record_to_files
+    std::string writer_cpus;        // spread over the writer pool
+    std::string dsp_cpus;           // spread over the subscribers of the receive thread
+    int rt_priority = 0;            // SCHED_FIFO priority for the receive thread, 0 for none
+    std::string channel_nodes;      // NUMA node of each channel's buffers, e.g. "0,0,1,1" (-1 for no preference), empty for none
+    bool prefault = false;          // fault the ring's pages in before streaming, instead of during the first pass
+    int debug_fill = -1;            // byte to fill the ring with before streaming, -1 to leave it uninitialised
+};
+
+// a full block of one channel, handed from the receive thread to the writers through an SpscFanout
+struct BlockDescriptor
+{
+    const void* data = nullptr;  // in the sample ring, valid until the slot is released
+    size_t samples = 0;
+    long long second = 0;        // start time of the block
+    int millisecond = 0;
+    size_t channel = 0;          // position in channel_nums / folders
+    size_t slot = 0;             // ring slot, released once written
+    bool gap = false;            // some samples were lost and zero-filled
+};
+
+// one recv call, for the monitor (size map, bandwidth summary, profile)
+struct PacketDescriptor
+{
+    size_t samples = 0;
+    std::chrono::steady_clock::time_point received;
+};
+
+struct RecorderResult
+{
+    unsigned long long samples = 0;  // per channel
+    double seconds = 0;              // from the first recv to the end of the loop
+    int64_t blocks = 0;
+    SourceMetadata::ErrorCode stopReason = SourceMetadata::NONE; // NONE if the recording ran its course
+    std::vector<unsigned long long> gaps;         // per channel, with --recover
+    std::vector<unsigned long long> samplesLost;  // per channel, zero-filled
+    int64_t blocksDropped = 0;       // channel blocks the writers' queue had no room for (a bug if ever non-zero)
+    WriterPoolStats writers;
+};
+
+// decides whether a block is worth writing, and whether it has saturated, in one pass over the samples
+// (the pass stops as soon as both answers are known, unless the full statistics are printed)
+template <typename samp_type>
+void scan_block(const samp_type *recdata, size_t length, double threshold, double saturation_warning, bool verbose, bool &toWrite, bool &saturated)
+{
+    BlockStats stats = scanBlock(recdata, length, threshold, saturation_warning, !verbose);
+    toWrite = threshold <= 0 || stats.aboveThreshold; // if threshold is 0, always write (default behaviour)
+
+    // check for saturation if specified
+    saturated = stats.saturated > 0;
+    if (saturated)
+        printf("Saturated samples found (> %.2f)%s", saturation_warning, verbose ? "" : "\n");
+    if (verbose)
+        printf("Block: max |x| %.2f, mean power %.2f, %zu samples saturated\n", stats.maxMagnitude(), stats.meanPower, stats.saturated);
+}
+
+// blocks starting on a second are named <second>.bin, and any others <second>_<milliseconds>.bin
+template <typename samp_type>
+void save_to_file(BlockWriter& writer, const std::string& folder, long long int second, int millisecond, const samp_type *recdata, size_t length, double threshold, double saturation_warning, bool verbose)
+{
+	char filename[512];
+	if (millisecond == 0)
+		snprintf(filename, 512, "%s%c%lld.bin", folder.c_str(), pathsplit, second);
+	else
+		snprintf(filename, 512, "%s%c%lld_%03d.bin", folder.c_str(), pathsplit, second, millisecond);
+    // printf("Writing to %s\n", filename);
+
+    bool toWrite, saturated;
+    scan_block(recdata, length, threshold, saturation_warning, verbose, toWrite, saturated);
+
+    if (toWrite)
+    {
+        auto t1 = std::chrono::steady_clock::now();
+        if (writer.write(filename, recdata, sizeof(samp_type) * length))
+        {
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+            printf("Wrote %s (%.1f MB/s).\n", filename, sizeof(samp_type) * length / secs / 1e6);
+        }
+    }
+
+}
+
+// as save_to_file, but into the capture file's slot for this block; blocks below the threshold are only marked in the index
+template <typename samp_type>
+void save_to_capture(CaptureFileWriter& capture, size_t channel_pos, long long int second, int millisecond, const samp_type *recdata, size_t length, double threshold, double saturation_warning, bool verbose, bool gap = false)
+{
+    bool toWrite, saturated;
+    scan_block(recdata, length, threshold, saturation_warning, verbose, toWrite, saturated);
+
+    uint32_t flags = (toWrite ? (uint32_t)CaptureIndexEntry::WRITTEN : (uint32_t)CaptureIndexEntry::SKIPPED)
+                     | (saturated ? (uint32_t)CaptureIndexEntry::SATURATED : 0u) | (gap ? (uint32_t)CaptureIndexEntry::GAP : 0u);
+    auto t1 = std::chrono::steady_clock::now();
+    if (capture.writeBlock(second, millisecond, channel_pos, toWrite ? recdata : nullptr, toWrite ? sizeof(samp_type) * length : 0, flags) && toWrite)
+    {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+        printf("Wrote %lld.%03d channel %zu to capture (%.1f MB/s).\n", second, millisecond, channel_pos, sizeof(samp_type) * length / secs / 1e6);
+    }
+}
+
+/*
+Records from source until the requested samples or duration are done, Ctrl-C, or the first error.
+folders holds the output folder of each channel, and channel_nums the USRP channel numbers written to capture files.
+The block length in samples must be a multiple of samps_per_buff.
+*/
+template <typename samp_type>
+RecorderResult record_to_files(SampleSource& source,
+    const std::vector<size_t> &channel_nums,
+    const std::vector<std::string> &folders,
+    const RecorderOptions& opt)
+{
+    RecorderResult result;
+    unsigned long long num_total_samps = 0;
+    // checked before anything is started
+    const std::vector<int> rx_cpus = thread_placement::parseCpus(opt.rx_cpus);
+    const std::vector<int> writer_cpus = thread_placement::parseCpus(opt.writer_cpus);
+    const std::vector<int> dsp_cpus = thread_placement::parseCpus(opt.dsp_cpus);
+    std::vector<int> channel_nodes;
+    if (!opt.channel_nodes.empty()) {
+        std::stringstream ss(opt.channel_nodes);
+        std::string node;
+        while (std::getline(ss, node, ','))
+            channel_nodes.push_back(std::stoi(node));
+        if (channel_nodes.size() != channel_nums.size())
+            throw std::runtime_error("Specify one NUMA node per channel (-1 for no preference).");
+    }
+    const bool verbose = opt.verbose;
+    const double threshold = opt.threshold;
+    const double saturation_warning = opt.saturation_warning;
+    const int block_ms = opt.block_ms;
+
+    SourceMetadata md;
+	int rx_rate = static_cast<int>(round(source.rate()));
+	// recovery turns timestamps into sample positions with the integer rate, which would drift with any other
+	if (opt.recover && std::fabs(source.rate() - rx_rate) > 1e-6)
+		throw std::runtime_error("--recover needs an integral sample rate, but the rate is " + std::to_string(source.rate()) + " S/s.");
+	int block_samps = static_cast<int>((long long)rx_rate * block_ms / 1000);
+	// One allocation for the whole ring: ring_depth blocks, each holding every channel
+	auto ring_start = std::chrono::steady_clock::now();
+	SampleRing<samp_type> ring(opt.ring_depth, channel_nums.size(), block_samps, true, channel_nodes, opt.prefault, opt.debug_fill);
+	printf("======= Using %zu blocks of %d ms (%d samples) per channel, %.1f MB in %s%s, ready in %.1f ms.\n",
+		opt.ring_depth, block_ms, block_samps, ring.region().size() / 1e6, ring.region().backing(), opt.prefault ? " (prefaulted)" : "",
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ring_start).count());
+	for (size_t i = 0; i < channel_nodes.size(); i++)
+		printf("======= Channel %zu buffers start on NUMA node %d (asked for %d; only nodes 0-63 can be asked for, and only the first page is checked).\n",
+			channel_nums[i], ring.channelNode(i), channel_nodes[i]);
+	// The pointer vector handed to recv, rewritten during the loop
+	std::vector<void*> buff_ptrs(channel_nums.size());
+
+	size_t tIdx = 0; // ring slot being filled
+	int bufIdx = 0; // used to index into the block
+
+    // persistent writers; each full block is held until all of its channels are written
+    size_t num_writers = opt.num_writers == 0 ? folders.size() : opt.num_writers;
+    std::unique_ptr<BlockWriter> block_writer = makeBlockWriter(opt.writer_backend, &ring.region());
+    printf("======= Writing with %s backend, %zu threads.\n", block_writer->name(), num_writers);
+    std::unique_ptr<CaptureFileWriter> capture; // opened once the start time is known
+    WriterPool writer_pool(num_writers, opt.ring_depth * folders.size());
+
+    bool overflow_message = true;
+
+    // setup streaming
+    long long first_second = source.start(opt.num_requested_samples);
+	printf("Streaming will start at %lld\n", first_second);
+
+    // one segmented file for all channels instead of a file per block per channel
+    if (!opt.capture_base.empty()) {
+        CaptureFileHeader info;
+        memset(&info, 0, sizeof(info));
+        info.sampleBytes = sizeof(samp_type);
+        info.numChannels = static_cast<uint32_t>(std::min<size_t>(channel_nums.size(), CaptureFileHeader::MAX_CHANNELS));
+        for (size_t i = 0; i < info.numChannels; i++)
+            info.channels[i] = static_cast<uint32_t>(channel_nums[i]);
+        info.sampleRate = rx_rate;
+        info.firstSecond = first_second;
+        info.blockMs = block_ms;
+        info.blocksPerSegment = std::max<uint64_t>(1, static_cast<uint64_t>(opt.segment_seconds * 1000 / block_ms));
+        info.blockBytes = sizeof(samp_type) * block_samps;
+        snprintf(info.cpuFormat, sizeof(info.cpuFormat), "%s", opt.cpu_format.c_str());
+        capture.reset(new CaptureFileWriter(opt.capture_base, info, opt.writer_backend != "stdio"));
+        printf("======= Writing to capture files %s\n", CaptureFileWriter::segmentPath(opt.capture_base, 0).c_str());
+    }
+
+    // The receive thread only receives and publishes. Handing blocks to the writer pool (which may wait for
+    // the disk) and all the bookkeeping happen on the subscribers' threads, so they can never delay recv.
+    SpscFanout<BlockDescriptor> block_fanout;
+    SpscFanout<PacketDescriptor> packet_fanout;
+    // never drops: at most ring_depth blocks of every channel can be outstanding
+    block_fanout.subscribe("writers", opt.ring_depth * folders.size(), [&](const BlockDescriptor& b){
+        writer_pool.submit([&folders, &ring, &block_writer, &capture, b, threshold, saturation_warning, verbose](){
+            {
+                ProfileZone<> save_zone(zone_profiler, "save_to_file");
+                const samp_type* recdata = static_cast<const samp_type*>(b.data);
+                if (capture)
+                    save_to_capture<samp_type>(*capture, b.channel, b.second, b.millisecond, recdata, b.samples, threshold, saturation_warning, verbose, b.gap);
+                else
+                    save_to_file<samp_type>(*block_writer, folders.at(b.channel), b.second, b.millisecond, recdata, b.samples, threshold, saturation_warning, verbose);
+            }
+            ring.release(b.slot);
+        });
+    });
+
+    typedef std::map<size_t, size_t> SizeMap;
+    SizeMap mapSizes;
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto stop_time =
+        start_time + std::chrono::milliseconds(int64_t(1000 * opt.time_requested));
+    // Track time and samps between updating the BW summary
+    auto last_update                     = start_time;
+    auto last_profile                    = start_time;
+    unsigned long long last_update_samps = 0;
+
+    // the monitor may miss packets when it falls behind, which only costs it some accuracy
+    const bool monitor = opt.enable_size_map || opt.bw_summary || opt.profile;
+    if (monitor)
+        packet_fanout.subscribe("monitor", 4096, [&](const PacketDescriptor& p){
+            if (opt.enable_size_map)
+                mapSizes[p.samples] += 1;
+
+            if (opt.bw_summary) {
+                last_update_samps += p.samples;
+                const auto time_since_last_update = p.received - last_update;
+                if (time_since_last_update > std::chrono::seconds(1)) {
+                    const double time_since_last_update_s =
+                        std::chrono::duration<double>(time_since_last_update).count();
+                    const double rate = double(last_update_samps) / time_since_last_update_s;
+                    std::cout << "\t" << (rate / 1e6) << " Msps" << std::endl;
+                    last_update_samps = 0;
+                    last_update       = p.received;
+                }
+            }
+
+            if (opt.profile && p.received - last_profile > std::chrono::seconds(1)) {
+                zone_profiler.report();
+                zone_profiler.reset();
+                last_profile = p.received;
+            }
+        });
+    block_fanout.start();
+    packet_fanout.start();
+
+    // ===== thread placement, applied now that every thread exists, then read back for the report
+    thread_placement::ScopedRestore restore_placement; // the calling thread is put back afterwards
+    thread_placement::apply("receive thread", thread_placement::self(), rx_cpus, opt.rt_priority);
+    thread_placement::spread("writer thread", writer_pool.threads(), writer_cpus);
+    std::vector<std::thread*> stage_threads = block_fanout.threads();
+    std::vector<std::string> stage_names;
+    for (auto& st : block_fanout.stats())
+        stage_names.push_back(st.name);
+    for (std::thread* t : packet_fanout.threads())
+        stage_threads.push_back(t);
+    for (auto& st : packet_fanout.stats())
+        stage_names.push_back(st.name);
+    thread_placement::spread("processing thread", stage_threads, dsp_cpus);
+
+    printf("======= Thread placement:\n  recv: %s\n", thread_placement::describe(thread_placement::self()).c_str());
+    std::vector<std::thread*> writer_threads = writer_pool.threads();
+    for (size_t i = 0; i < writer_threads.size(); i++)
+        printf("  writer %zu: %s\n", i, thread_placement::describe(writer_threads[i]->native_handle()).c_str());
+    for (size_t i = 0; i < stage_threads.size(); i++)
+        printf("  %s: %s\n", stage_names[i].c_str(), thread_placement::describe(stage_threads[i]->native_handle()).c_str());
+    // =====
+
+	// counter of blocks so far
+	int64_t numBlocksWritten = 0;
+	bool block_gap = false; // the block being filled has zero-filled samples in it
+
+    // publishes the full block of each channel, then waits for the next slot to come back from the writers
+    auto complete_block = [&]()
+    {
+        ProfileZone<> dispatch_zone(zone_profiler, "publish block");
+        // the writers own the slot until they release it
+        // (rxtime is not accurate for twinRX, so the start time is a plain counter based on start timing)
+        long long int block_start_ms = numBlocksWritten * block_ms;
+        if (!opt.null)
+        {
+            ring.handOff(tIdx, (int)folders.size());
+            BlockDescriptor b;
+            b.samples = block_samps;
+            b.second = first_second + block_start_ms / 1000;
+            b.millisecond = static_cast<int>(block_start_ms % 1000);
+            b.slot = tIdx;
+            b.gap = block_gap;
+            for (size_t i = 0; i < folders.size(); i++){
+                b.data = ring.block(tIdx, i);
+                b.channel = i;
+                if (block_fanout.publish(b) > 0){
+                    // can't happen while the queue holds every outstanding block, but if it ever does,
+                    // give the writer's share of the slot back so acquire() doesn't wait for it forever
+                    fprintf(stderr, "======= Error: the writers' queue was full, block %lld.%03d of channel %zu is lost\n",
+                            b.second, b.millisecond, i);
+                    ring.release(tIdx);
+                    result.blocksDropped++;
+                }
+            }
+        }
+
+        // update indices
+        tIdx = (tIdx + 1) % ring.depth();
+        bufIdx = 0;
+        block_gap = false;
+
+        numBlocksWritten += 1;
+
+        // the next slot must be back from the writers before recv writes into it again
+        double waited = ring.acquire(tIdx);
+        if (waited > 0){
+            writer_pool.noteBufferStall(waited);
+            if (verbose) {printf("Waited %.3f s for block %zu to be written\n", waited, tIdx);}
+        }
+    };
+
+    // ===== recovery: samples the stream lost are zero-filled where they belonged, so blocks stay on their seconds
+    result.gaps.assign(channel_nums.size(), 0);
+    result.samplesLost.assign(channel_nums.size(), 0);
+    unsigned long long num_lost_samps = 0;
+    std::vector<std::vector<samp_type>> held; // a received buffer, moved aside while the gap before it is filled
+    FILE *gap_log = NULL;
+    if (opt.recover) {
+        held.assign(channel_nums.size(), std::vector<samp_type>(opt.samps_per_buff));
+        if (!opt.gap_log.empty()) {
+            // appended to, so the gaps of earlier recordings into the same folder are kept
+            gap_log = fopen(opt.gap_log.c_str(), "a");
+            if (gap_log == NULL)
+                fprintf(stderr, "Could not open gap log %s, gaps will only be counted\n", opt.gap_log.c_str());
+            else
+                fprintf(gap_log, "# recording starting at second %lld, %d samples/s\n"
+                                 "# second, sample in second, samples lost (zero-filled), reason\n", first_second, rx_rate);
+        }
+    }
+    const char *gap_reason = "out of sequence";
+    long long time_offset = 0; // samples the stream's timestamps have stepped back by, so they line up with the recording again
+
+    // writes n samples of each channel at the fill position, from src (or zeros), completing blocks as they fill up
+    auto place = [&](const std::vector<std::vector<samp_type>> *src, unsigned long long n)
+    {
+        unsigned long long done = 0;
+        while (done < n) {
+            size_t len = static_cast<size_t>(std::min<unsigned long long>(n - done, block_samps - bufIdx));
+            for (size_t i = 0; i < channel_nums.size(); i++) {
+                if (src)
+                    memcpy(ring.block(tIdx, i) + bufIdx, src->at(i).data() + done, len * sizeof(samp_type));
+                else
+                    memset(static_cast<void*>(ring.block(tIdx, i) + bufIdx), 0, len * sizeof(samp_type));
+            }
+            if (!src)
+                block_gap = true;
+            bufIdx += static_cast<int>(len);
+            done += len;
+            if (bufIdx == block_samps)
+                complete_block();
+        }
+    };
+    // =====
+
+    // Run this loop until either time expired (if a duration was given), until
+    // the requested number of samples were collected (if such a number was
+    // given), or until Ctrl-C was pressed.
+    while (not stop_signal_called
+           and (opt.num_requested_samples == 0 or num_total_samps + num_lost_samps < opt.num_requested_samples)
+           and (opt.time_requested == 0.0 or std::chrono::steady_clock::now() <= stop_time)) {
+        ProfileZone<> loop_zone(zone_profiler, "recv loop");
+
+		// write the vector of pointers before receiving
+		for (size_t i = 0; i < channel_nums.size(); i++){
+			buff_ptrs.at(i) = ring.block(tIdx, i) + bufIdx;
+		}
+		// perform the receive (after a recovered gap, the block may not end on a whole buffer)
+        size_t num_rx_samps;
+        {
+            ProfileZone<> recv_zone(zone_profiler, "recv");
+            num_rx_samps = source.recv(buff_ptrs, std::min<size_t>(opt.samps_per_buff, block_samps - bufIdx), md, 3.0, opt.enable_size_map); // we edit to write at bufIdx
+        }
+
+        if (md.error == SourceMetadata::TIMEOUT) {
+            std::cout << "Timeout while streaming" << std::endl;
+            result.stopReason = md.error;
+            break;
+        }
+        if (md.error == SourceMetadata::OVERFLOW) {
+            if (overflow_message) {
+                overflow_message = false;
+                fprintf(stderr,
+                        "Got an overflow indication. Please consider the following:\n"
+                        "  Your write medium must sustain a rate of %fMB/s.\n"
+                        "  Dropped samples will not be written to the file.\n"
+                        "  Please modify this example for your purposes.\n"
+                        "  This message will not appear again.\n",
+                        source.rate() * sizeof(samp_type) / 1e6);
+            }
+            if (opt.recover) {
+                gap_reason = "overflow";
+                continue; // the next packet's timestamp says how much was lost
+            }
+            // continue;
+            result.stopReason = md.error;
+			break; // we want to ensure timing integrity, so if overflow let's end
+        }
+        if (md.error != SourceMetadata::NONE) {
+            std::cerr << "Receiver error: " << md.errorString << std::endl;
+            if (opt.recover) {
+                gap_reason = "receiver error";
+                continue;
+            }
+            result.stopReason = md.error;
+            break; // again, ensure timing integrity, always break
+        }
+
+        if (monitor) {
+            PacketDescriptor p;
+            p.samples = num_rx_samps;
+            p.received = std::chrono::steady_clock::now();
+            packet_fanout.publish(p);
+        }
+
+        num_total_samps += num_rx_samps;
+
+		// ============ check buffers
+		if (verbose) {printf("Buf: %zu. W: %d\n", tIdx, bufIdx);}
+
+        // where the stream says these samples belong, against where they were put
+        if (opt.recover && md.hasTime && num_rx_samps > 0) {
+            long long expected = numBlocksWritten * block_samps + bufIdx;
+            long long position = (md.fullSecs - first_second) * rx_rate + llround(md.fracSecs * rx_rate) + time_offset;
+            long long lost = position - expected;
+            if (lost > static_cast<long long>(opt.max_gap_seconds * rx_rate)) {
+                fprintf(stderr, "Gap of %.3f s at %lld.%09lld is too long to fill in, stopping.\n",
+                        (double)lost / rx_rate, first_second + expected / rx_rate, (expected % rx_rate) * 1000000000LL / rx_rate);
+                result.stopReason = SourceMetadata::OTHER;
+                break;
+            }
+            if (lost != 0) {
+                ProfileZone<> gap_zone(zone_profiler, "fill gap");
+                // time going backwards is logged once: the samples are kept where they are, and later
+                // timestamps are shifted by the step so they aren't all reported as out of place
+                const char *reason = lost > 0 ? gap_reason : "time went backwards";
+                if (gap_log != NULL) {
+                    fprintf(gap_log, "%lld, %lld, %lld, %s\n", first_second + expected / rx_rate, expected % rx_rate, lost, reason);
+                    fflush(gap_log);
+                }
+                printf("Gap of %lld samples at %lld + %lld samples (%s)\n", lost, first_second + expected / rx_rate, expected % rx_rate, reason);
+                if (lost < 0)
+                    time_offset -= lost;
+            }
+            gap_reason = "out of sequence";
+            if (lost > 0) {
+                for (size_t i = 0; i < channel_nums.size(); i++) {
+                    memcpy(held[i].data(), ring.block(tIdx, i) + bufIdx, num_rx_samps * sizeof(samp_type));
+                    result.gaps[i]++;
+                    result.samplesLost[i] += lost;
+                }
+                num_lost_samps += lost;
+                place(nullptr, lost);
+                place(&held, num_rx_samps);
+                continue;
+            }
+        }
+
+		// update the new idx to write to
+		bufIdx = bufIdx + num_rx_samps;
+		if (bufIdx == block_samps) // then move to next block
+			complete_block();
+		// ==========================
+    }
+    const auto actual_stop_time = std::chrono::steady_clock::now();
+
+    source.stop();
+
+    // finish writing everything already received
+    block_fanout.stop();
+    writer_pool.waitIdle();
+    packet_fanout.stop();
+    if (gap_log != NULL)
+        fclose(gap_log);
+
+    result.samples = num_total_samps;
+    result.seconds = std::chrono::duration<double>(actual_stop_time - start_time).count();
+    result.blocks = numBlocksWritten;
+    result.writers = writer_pool.stats();
+
+    if (opt.stats) {
+        std::cout << std::endl;
+        printf("Received %llu samples in %f seconds\n", num_total_samps, result.seconds);
+        const double rate = (double)num_total_samps / result.seconds;
+        std::cout << (rate / 1e6) << " Msps" << std::endl;
+
+        writer_pool.printStats();
+        block_fanout.printStats("Blocks");
+        packet_fanout.printStats("Packets");
+        if (opt.recover)
+            for (size_t i = 0; i < channel_nums.size(); i++)
+                printf("Channel %zu: %llu gaps, %llu samples zero-filled\n", channel_nums[i], result.gaps[i], result.samplesLost[i]);
+
+        if (opt.enable_size_map) {
+            std::cout << std::endl;
+            std::cout << "Packet size map (bytes: count)" << std::endl;
+            for (SizeMap::iterator it = mapSizes.begin(); it != mapSizes.end(); it++)
+                std::cout << it->first << ":\t" << it->second << std::endl;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Segmented capture file: one large preallocated file holding many blocks of every channel.
+
+    [header, 4096 bytes][index: blocksPerSegment x numChannels entries][data, appended in 4096-byte steps]
+
+The index is dense: the entry of a block is at (block number in the segment) * numChannels + channel position,
+whether or not the block was stored, so any second can be found in O(1) without scanning.
+Blocks are appended to the data area in whatever order the writers finish them.
+Once blocksPerSegment block periods have passed, the recorder moves on to the next segment file,
+<base>_<segment>.iqc, so a multi-day capture is a handful of large files instead of millions of small ones.
+*/
+struct CaptureFileHeader
+{
+    static const uint32_t VERSION = 1;
+    static const uint32_t MAX_CHANNELS = 32;
+
+    char magic[8];               // "IQCAPT1"
+    uint32_t version;
+    uint32_t headerBytes;
+    uint32_t sampleBytes;        // bytes per (complex) sample
+    uint32_t numChannels;
+    uint32_t channels[MAX_CHANNELS]; // USRP channel number at each position
+    double sampleRate;
+    int64_t firstSecond;         // start of the segment's first block
+    uint32_t firstMillisecond;
+    uint32_t blockMs;
+    uint64_t blocksPerSegment;
+    uint64_t blockBytes;         // bytes in a full block of one channel
+    uint64_t segment;            // 0 for the first file of a capture
+    uint64_t indexOffset;
+    uint64_t dataOffset;
+    char cpuFormat[16];          // e.g. "sc16"
+};
+
+struct CaptureIndexEntry
+{
+    enum Flags : uint32_t {
+        WRITTEN   = 1,  // data is stored at offset
+        SKIPPED   = 2,  // received, but not stored (e.g. below the threshold)
+        SATURATED = 4,
+        GAP       = 8   // some samples in the block were lost and filled in
+    };
+
+    int64_t second;
+    uint32_t millisecond;
+    uint32_t channel;   // USRP channel number
+    uint64_t offset;    // from the start of the file
+    uint64_t length;    // bytes
+    uint32_t flags;     // 0 if nothing was recorded for this block
+    uint32_t reserved;
+};
+
+#ifdef __linux__
+
+namespace capture_file_detail
+{
+    const uint64_t ALIGN = 4096;
+    const uint64_t PREALLOCATE_STEP = 1ull << 32; // data space is preallocated 4 GiB at a time, not a whole segment up front
+
+    inline uint64_t roundUp(uint64_t v) { return (v + ALIGN - 1) / ALIGN * ALIGN; }
+
+    inline bool pwriteAll(int fd, const char *data, size_t bytes, off_t offset)
+    {
+        while (bytes > 0){
+            ssize_t n = pwrite(fd, data, bytes, offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            bytes -= n;
+            offset += n;
+        }
+        return true;
+    }
+}
+
+/*
+Writes blocks into segmented capture files. writeBlock() may be called from several threads at once;
+space in the data area is claimed under a lock, and the copy itself runs unlocked.
+With direct, data is written with O_DIRECT (from 4096-byte aligned memory, as SampleRing blocks are).
+Data space is preallocated in steps of PREALLOCATE_STEP as a segment fills, and each segment is truncated
+to the data actually stored when it is closed. A segment is only created (and truncated) once; a writer
+that lags behind into a segment the recorder has moved on from appends through the handle another
+writer still holds, or reopens the file if there is none. Only the last handle on a file trims it.
+Every writeBlock() call must have returned before the writer is destroyed.
+
+Example:
+    CaptureFileWriter cap("/data/cap", header); // header fields describe the stream; the rest are filled in
+    cap.writeBlock(second, 0, channelPos, data, bytes, CaptureIndexEntry::WRITTEN);
+*/
+class CaptureFileWriter
+{
+public:
+    CaptureFileWriter(const std::string &basePath, const CaptureFileHeader &streamInfo, bool direct = false)
+        : m_base(basePath), m_info(streamInfo), m_direct(direct)
+    {
+        memcpy(m_info.magic, "IQCAPT1", 8);
+        m_info.version = CaptureFileHeader::VERSION;
+        m_info.headerBytes = (uint32_t)capture_file_detail::ALIGN;
+        m_info.indexOffset = m_info.headerBytes;
+        m_info.dataOffset = capture_file_detail::roundUp(
+            m_info.indexOffset + m_info.blocksPerSegment * m_info.numChannels * sizeof(CaptureIndexEntry));
+    }
+
+    ~CaptureFileWriter()
+    {
+        std::map<uint64_t, std::shared_ptr<Segment>> segments;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            segments.swap(m_segments);
+        }
+        // closed (and trimmed) here, as that takes m_mutex
+    }
+
+    CaptureFileWriter(const CaptureFileWriter&) = delete;
+    CaptureFileWriter& operator=(const CaptureFileWriter&) = delete;
+
+    static std::string segmentPath(const std::string &basePath, uint64_t segment)
+    {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "_%06llu.iqc", (unsigned long long)segment);
+        return basePath + suffix;
+    }
+
+    /*
+    Records one channel's block starting at second + millisecond. Pass data = nullptr (and bytes = 0)
+    to only record flags, e.g. SKIPPED for a block that fell below the threshold.
+    Returns false, after printing why, if the block is before the capture start or could not be written.
+    */
+    bool writeBlock(long long second, int millisecond, size_t channelPos, const void *data, size_t bytes, uint32_t flags)
+    {
+        using namespace capture_file_detail;
+        long long sinceStart = (second - m_info.firstSecond) * 1000 + millisecond - (long long)m_info.firstMillisecond;
+        if (sinceStart < 0 || channelPos >= m_info.numChannels || bytes > m_info.blockBytes){
+            printf("Block at %lld.%03d, channel position %zu does not fit the capture file\n", second, millisecond, channelPos);
+            return false;
+        }
+        uint64_t blockNo = (uint64_t)sinceStart / m_info.blockMs;
+        uint64_t segmentNo = blockNo / m_info.blocksPerSegment;
+
+        std::shared_ptr<Segment> seg;
+        std::vector<std::shared_ptr<Segment>> retired; // released after the lock, as closing a segment takes it
+        uint64_t offset = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            seg = segment(segmentNo, retired);
+            if (!seg)
+                return false;
+            if (data != nullptr && bytes > 0){
+                offset = seg->end;
+                seg->end += roundUp(bytes);
+                if (seg->end > seg->allocated)
+                    preallocate(*seg, seg->end);
+            }
+        }
+
+        CaptureIndexEntry e;
+        memset(&e, 0, sizeof(e));
+        e.second = second;
+        e.millisecond = (uint32_t)millisecond;
+        e.channel = m_info.channels[channelPos];
+        e.flags = flags;
+        if (data != nullptr && bytes > 0){
+            e.offset = offset;
+            e.length = bytes;
+            bool ok = writeData(*seg, static_cast<const char*>(data), bytes, offset);
+            if (!ok){
+                printf("Failed to write block %lld.%03d to %s : %s\n", second, millisecond, seg->path.c_str(), strerror(errno));
+                e.flags &= ~(uint32_t)CaptureIndexEntry::WRITTEN;
+                e.offset = e.length = 0;
+            }
+        }
+        bool stored = data == nullptr || bytes == 0 || (e.flags & CaptureIndexEntry::WRITTEN) != 0;
+
+        // the index entry goes in last, so a reader never finds an entry whose data isn't there yet
+        uint64_t entryNo = (blockNo % m_info.blocksPerSegment) * m_info.numChannels + channelPos;
+        return pwriteAll(seg->indexFd, reinterpret_cast<const char*>(&e), sizeof(e),
+                         (off_t)(m_info.indexOffset + entryNo * sizeof(e))) && stored;
+    }
+
+    const CaptureFileHeader& info() const { return m_info; }
+
+private:
+    struct Segment
+    {
+        uint64_t number = 0;
+        uint64_t generation = 0; // which opening of the file this is
+        std::string path;
+        int fd = -1;        // data, O_DIRECT if requested
+        int indexFd = -1;   // header and index, buffered
+        uint64_t end = 0;   // next free data offset
+        uint64_t allocated = 0; // bytes preallocated so far
+        bool direct = false;
+
+        ~Segment()
+        {
+            if (indexFd >= 0)
+                close(indexFd);
+            if (fd >= 0)
+                close(fd);
+        }
+    };
+
+    struct Opened
+    {
+        std::weak_ptr<Segment> seg; // the latest handle, which a lagging writer may hold after the recorder moved on
+        uint64_t generation = 0;
+    };
+
+    std::string m_base;
+    CaptureFileHeader m_info;
+    bool m_direct;
+    std::mutex m_mutex;
+    std::map<uint64_t, Opened> m_opened; // every segment opened so far; one already created is never truncated again
+    std::map<uint64_t, std::shared_ptr<Segment>> m_segments;
+
+    /*
+    Opens the segment, creating it (header, zeroed index, first preallocation) on first use; called with m_mutex held.
+    Handles dropped as the recorder moves on are put in retired, for the caller to release once it has unlocked.
+    */
+    std::shared_ptr<Segment> segment(uint64_t n, std::vector<std::shared_ptr<Segment>> &retired)
+    {
+        auto it = m_segments.find(n);
+        if (it != m_segments.end())
+            return it->second;
+
+        auto op = m_opened.find(n);
+        bool reopen = op != m_opened.end();
+        if (reopen){
+            // a writer still busy in it keeps the handle alive; appending through a second one would race its trim
+            std::shared_ptr<Segment> live = op->second.seg.lock();
+            if (live){
+                m_segments[n] = live;
+                return live;
+            }
+        }
+        std::shared_ptr<Segment> seg(new Segment(), [this](Segment *s){ closeSegment(s); });
+        seg->number = n;
+        seg->generation = reopen ? op->second.generation + 1 : 0;
+        seg->path = segmentPath(m_base, n);
+        seg->indexFd = open(seg->path.c_str(), reopen ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (seg->indexFd < 0){
+            printf("Failed to %s %s : %s\n", reopen ? "reopen" : "create", seg->path.c_str(), strerror(errno));
+            retired.push_back(seg);
+            return nullptr;
+        }
+        m_opened[n].seg = seg;
+        m_opened[n].generation = seg->generation;
+        seg->fd = m_direct ? open(seg->path.c_str(), O_WRONLY | O_DIRECT) : -1;
+        seg->direct = seg->fd >= 0;
+        if (seg->fd < 0)
+            seg->fd = open(seg->path.c_str(), O_WRONLY);
+
+        if (reopen){
+            // it was trimmed to its stored data when closed (or is about to be, by a handle whose trim this one supersedes),
+            // so append after that
+            struct stat st;
+            uint64_t size = fstat(seg->indexFd, &st) == 0 ? (uint64_t)st.st_size : 0;
+            seg->end = seg->allocated = size > m_info.dataOffset ? capture_file_detail::roundUp(size) : m_info.dataOffset;
+            printf("======= Reopened %s for a late block\n", seg->path.c_str());
+            m_segments[n] = seg;
+            return seg;
+        }
+        seg->end = m_info.dataOffset;
+
+        // sizing the file zeroes the whole index, so it starts out as 'nothing recorded'
+        if (ftruncate(seg->indexFd, (off_t)m_info.dataOffset) != 0)
+            printf("Failed to size %s : %s\n", seg->path.c_str(), strerror(errno));
+        seg->allocated = m_info.dataOffset;
+        preallocate(*seg, m_info.dataOffset + 1);
+        CaptureFileHeader h = m_info;
+        h.segment = n;
+        uint64_t blockNo = n * m_info.blocksPerSegment;
+        long long startMs = (long long)m_info.firstMillisecond + (long long)(blockNo * m_info.blockMs);
+        h.firstSecond = m_info.firstSecond + startMs / 1000;
+        h.firstMillisecond = (uint32_t)(startMs % 1000);
+        std::vector<char> page(m_info.headerBytes, 0);
+        memcpy(page.data(), &h, sizeof(h));
+        capture_file_detail::pwriteAll(seg->indexFd, page.data(), page.size(), 0);
+
+        // writers of the previous segment may still be finishing; anything older is closed once they're done
+        while (!m_segments.empty() && m_segments.begin()->first + 1 < n){
+            retired.push_back(m_segments.begin()->second);
+            m_segments.erase(m_segments.begin());
+        }
+        m_segments[n] = seg;
+        return seg;
+    }
+
+    // the deleter of a segment handle, run by whichever thread lets go of it last
+    void closeSegment(Segment *s)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // a handle reopened since this one was let go has appended past this one's end, and trims the file itself
+            auto op = m_opened.find(s->number);
+            if (s->indexFd >= 0 && op != m_opened.end() && op->second.generation == s->generation)
+                if (ftruncate(s->indexFd, (off_t)s->end) != 0)
+                    printf("Failed to trim %s : %s\n", s->path.c_str(), strerror(errno));
+        }
+        delete s;
+    }
+
+    // extends the segment's preallocation, a step at a time, to cover at least upTo (never past a full segment)
+    void preallocate(Segment &seg, uint64_t upTo)
+    {
+        using namespace capture_file_detail;
+        uint64_t full = m_info.dataOffset + m_info.blocksPerSegment * m_info.numChannels * roundUp(m_info.blockBytes);
+        uint64_t target = seg.allocated + PREALLOCATE_STEP;
+        if (target < upTo)
+            target = upTo;
+        if (target > full)
+            target = full;
+        if (target <= seg.allocated)
+            return;
+        if (fallocate(seg.indexFd, 0, (off_t)seg.allocated, (off_t)(target - seg.allocated)) != 0){
+            if (errno != EOPNOTSUPP)
+                printf("Failed to preallocate %s : %s\n", seg.path.c_str(), strerror(errno));
+        }
+        // without preallocation, writes past the end simply extend the file, so don't retry until the next step
+        seg.allocated = target;
+    }
+
+    bool writeData(Segment &seg, const char *data, size_t bytes, uint64_t offset)
+    {
+        using namespace capture_file_detail;
+        if (!seg.direct || reinterpret_cast<uintptr_t>(data) % ALIGN != 0)
+            return pwriteAll(seg.direct ? seg.indexFd : seg.fd, data, bytes, (off_t)offset);
+        size_t aligned = bytes / ALIGN * ALIGN;
+        if (!pwriteAll(seg.fd, data, aligned, (off_t)offset))
+            return false;
+        // the unaligned tail goes through the buffered descriptor
+        return pwriteAll(seg.indexFd, data + aligned, bytes - aligned, (off_t)(offset + aligned));
+    }
+};
+
+/*
+Maps one capture file segment read-only; finding a block is an index lookup.
+
+Example:
+    CaptureFileReader rd("/data/cap_000000.iqc");
+    const CaptureIndexEntry *e = rd.find(1600000123, 0, 1);
+    if (e != nullptr) process(rd.data<std::complex<short>>(*e), e->length / rd.header().sampleBytes);
+*/
+class CaptureFileReader
+{
+public:
+    CaptureFileReader(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open " + path + " : " + strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CaptureFileHeader)){
+            close(fd);
+            throw std::runtime_error(path + " is too small to be a capture file");
+        }
+        m_bytes = (size_t)st.st_size;
+        m_map = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m_map == MAP_FAILED){
+            m_map = nullptr;
+            throw std::runtime_error("Failed to map " + path + " : " + strerror(errno));
+        }
+        const CaptureFileHeader &h = header();
+        if (memcmp(h.magic, "IQCAPT1", 8) != 0 || h.version != CaptureFileHeader::VERSION
+            || h.indexOffset + numEntries() * sizeof(CaptureIndexEntry) > m_bytes){
+            munmap(m_map, m_bytes);
+            throw std::runtime_error(path + " is not a capture file");
+        }
+    }
+
+    ~CaptureFileReader()
+    {
+        if (m_map != nullptr)
+            munmap(m_map, m_bytes);
+    }
+
+    CaptureFileReader(const CaptureFileReader&) = delete;
+    CaptureFileReader& operator=(const CaptureFileReader&) = delete;
+
+    const CaptureFileHeader& header() const { return *static_cast<const CaptureFileHeader*>(m_map); }
+
+    size_t numEntries() const { return header().blocksPerSegment * header().numChannels; }
+
+    const CaptureIndexEntry& entry(size_t i) const
+    {
+        return reinterpret_cast<const CaptureIndexEntry*>(static_cast<const char*>(m_map) + header().indexOffset)[i];
+    }
+
+    // the block of the channel at channelPos starting at second + millisecond, or null if it isn't in this segment or wasn't recorded
+    const CaptureIndexEntry* find(long long second, int millisecond, size_t channelPos) const
+    {
+        const CaptureFileHeader &h = header();
+        long long sinceStart = (second - h.firstSecond) * 1000 + millisecond - (long long)h.firstMillisecond;
+        if (sinceStart < 0 || sinceStart % h.blockMs != 0 || channelPos >= h.numChannels)
+            return nullptr;
+        uint64_t blockNo = (uint64_t)sinceStart / h.blockMs;
+        if (blockNo >= h.blocksPerSegment)
+            return nullptr;
+        const CaptureIndexEntry &e = entry(blockNo * h.numChannels + channelPos);
+        return e.flags != 0 ? &e : nullptr;
+    }
+
+    // null unless the entry's data is stored
+    template <typename samp_type = char>
+    const samp_type* data(const CaptureIndexEntry &e) const
+    {
+        if (!(e.flags & CaptureIndexEntry::WRITTEN) || e.offset + e.length > m_bytes)
+            return nullptr;
+        return reinterpret_cast<const samp_type*>(static_cast<const char*>(m_map) + e.offset);
+    }
+
+private:
+    void *m_map = nullptr;
+    size_t m_bytes = 0;
+};
+
+#else
+
+// capture files need pwrite/fallocate/mmap; elsewhere these just report that
+class CaptureFileWriter
+{
+public:
+    CaptureFileWriter(const std::string &, const CaptureFileHeader &, bool = false)
+    {
+        throw std::runtime_error("Capture files are only supported on Linux");
+    }
+    static std::string segmentPath(const std::string &basePath, uint64_t segment)
+    {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "_%06llu.iqc", (unsigned long long)segment);
+        return basePath + suffix;
+    }
+    bool writeBlock(long long, int, size_t, const void *, size_t, uint32_t) { return false; }
+};
+
+#endif
@@ -0,0 +1,2 @@
+mkdir bin
+g++ -std=c++17 recorder_bench.cpp -L$HOME/boost_1_72_0/lib -I$HOME/boost_1_72_0/include -O2 -lboost_filesystem -lpthread -lboost_program_options -o bin/recorder_bench
@@ -0,0 +1,188 @@
+//
+// Runs the rx_samples_to_file_buffered recording pipeline against an emulated source instead of a USRP,
+// to regression test it and to find the highest rate the storage keeps up with, on any Linux box.
+//
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <complex>
+#include <csignal>
+#include <iostream>
+
+#include "buffered_recorder.h"
+
+namespace po = boost::program_options;
+
+template <typename samp_type>
+int run_bench(const po::variables_map& vm, const std::string& cpu_format, size_t num_channels, std::vector<std::string>& folders,
+    const std::vector<std::string>& replay_files, const SourceFaults& faults, RecorderOptions options)
+{
+    options.cpu_format = cpu_format;
+    double rate = vm["rate"].as<double>();
+    size_t packet = vm["packet"].as<size_t>();
+    bool paced = vm.count("paced") > 0;
+
+    std::unique_ptr<EmulatedSource> source;
+    if (replay_files.empty())
+        source.reset(new SyntheticSource<samp_type>(rate, num_channels, packet, paced, faults, vm["amplitude"].as<double>()));
+    else
+        source.reset(new FileReplaySource<samp_type>(replay_files, rate, packet, paced, vm.count("loop") > 0, faults));
+    std::cout << "Source: " << source->description() << std::endl;
+
+    std::vector<size_t> channel_nums;
+    for (size_t i = 0; i < num_channels; i++)
+        channel_nums.push_back(i);
+
+    RecorderResult r = record_to_files<samp_type>(*source, channel_nums, folders, options);
+
+    const SourceStats& s = source->stats();
+    double msps = r.samples / r.seconds / 1e6;
+    std::cout << std::endl;
+    printf("Recorded %llu samples x %zu channels in %lld blocks, %.3f s\n", r.samples, num_channels, (long long)r.blocks, r.seconds);
+    printf("  %llu packets, %llu overflows (%llu samples lost), %llu timeouts\n",
+        s.packets, s.overflows, s.samplesLost, s.timeouts);
+    printf("  writers waited on the disk %llu times (%.3f s), receiver waited for buffers %llu times (%.3f s)\n",
+        (unsigned long long)r.writers.queueFullStalls, r.writers.queueFullWaitSeconds,
+        (unsigned long long)r.writers.bufferStalls, r.writers.bufferWaitSeconds);
+    if (paced)
+        printf("%s at %.3f MS/s per channel\n", s.overflows == 0 ? "Sustained" : "Overflowed", rate / 1e6);
+    else
+        // unpaced, the receiver only ever waits for the writers, so this is the rate they keep up with
+        printf("Max sustainable rate: %.3f MS/s per channel (%.1f MB/s to disk)\n",
+            msps, msps * num_channels * sizeof(samp_type));
+    if (r.blocksDropped > 0)
+        printf("  %lld blocks were dropped before reaching the writers\n", (long long)r.blocksDropped);
+    return (r.stopReason == SourceMetadata::NONE || r.stopReason == SourceMetadata::TIMEOUT) && r.blocksDropped == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string type, folder, writer_backend, capture_name, replay_list;
+    size_t num_channels, total_num_samps, spb, num_writers, ring_depth;
+    int block_ms;
+    double total_time, threshold, saturation_warning, segment_seconds;
+    SourceFaults faults;
+
+    po::options_description desc("Allowed options");
+    // clang-format off
+    desc.add_options()
+        ("help", "help message")
+        ("type", po::value<std::string>(&type)->default_value("short"), "sample type: double, float, short, or byte")
+        ("rate", po::value<double>()->default_value(10e6), "emulated sample rate")
+        ("channels", po::value<size_t>(&num_channels)->default_value(1), "number of emulated channels")
+        ("packet", po::value<size_t>()->default_value(2000), "samples per emulated packet")
+        ("paced", "deliver samples in real time at --rate, with overflows if the recorder falls behind (otherwise as fast as possible)")
+        ("amplitude", po::value<double>()->default_value(0.3), "tone amplitude as a fraction of full scale")
+        ("replay", po::value<std::string>(&replay_list)->default_value(""), "comma-separated raw sample files to replay, one per channel, instead of the synthetic tone")
+        ("loop", "loop the replayed files")
+        ("overflow-rate", po::value<double>(&faults.overflowsPerSecond)->default_value(0), "injected overflows per second of stream")
+        ("overflow-samples", po::value<size_t>(&faults.overflowSamples)->default_value(0), "samples lost in each injected overflow (one packet if 0)")
+        ("timeout-rate", po::value<double>(&faults.timeoutsPerSecond)->default_value(0), "injected timeouts per second of stream")
+        ("seed", po::value<unsigned long long>(&faults.seed)->default_value(1), "seed for the injected faults and the noise")
+        ("nsamps", po::value<size_t>(&total_num_samps)->default_value(0), "total number of samples to receive")
+        ("duration", po::value<double>(&total_time)->default_value(10), "total number of seconds to receive")
+        ("spb", po::value<size_t>(&spb)->default_value(10000), "samples per buffer")
+        ("null", "run without writing to file")
+        ("sizemap", "track packet size and display breakdown on exit")
+        ("progress", "periodically display short-term bandwidth")
+        ("verbose", "turn on verbose reporting")
+        ("profile", "print a breakdown of where the receive loop spends each second")
+        ("rx-cpus", po::value<std::string>()->default_value(""), "cores for the receive thread, e.g. \"2\", \"2-3\" or \"node:0\" for every core of NUMA node 0")
+        ("writer-cpus", po::value<std::string>()->default_value(""), "cores to spread the writer threads over, one each")
+        ("dsp-cpus", po::value<std::string>()->default_value(""), "cores to spread the processing threads (writer dispatch, monitor) over, one each")
+        ("rt-priority", po::value<int>()->default_value(0), "SCHED_FIFO priority for the receive thread (1-99, needs CAP_SYS_NICE or an rtprio limit), 0 for none")
+        ("channel-nodes", po::value<std::string>()->default_value(""), "NUMA node for each channel's buffers, e.g. \"0,1\" (-1 for no preference); put the writers on the same nodes with --writer-cpus")
+        ("prefault", "fault in all buffer memory before streaming starts, so the first second doesn't pay for page faults")
+        ("debug-fill", po::value<int>()->default_value(-1), "fill the buffers with this byte value before streaming, to spot samples never written (-1 to leave them uninitialised)")
+        ("recover", "on overflows and receiver errors, zero-fill the lost samples (from the metadata timestamps) and keep recording, listing the gaps in <folder>/gaps.txt")
+        ("writers", po::value<size_t>(&num_writers)->default_value(0), "number of file writer threads (0 for one per channel)")
+        ("ring-depth", po::value<size_t>(&ring_depth)->default_value(2), "number of blocks buffered per channel while they are written")
+        ("block-ms", po::value<int>(&block_ms)->default_value(1000), "duration of each block (and file) in milliseconds")
+        ("writer", po::value<std::string>(&writer_backend)->default_value("stdio"), "file writing backend: stdio, direct or io_uring")
+        ("capture-file", po::value<std::string>(&capture_name)->default_value(""), "write into segmented capture files <folder>/<name>_<segment>.iqc")
+        ("segment-seconds", po::value<double>(&segment_seconds)->default_value(3600), "duration held by each capture file segment")
+        ("folder", po::value<std::string>(&folder)->default_value("bench"), "path to write files to (will be created if it doesn't exist)")
+        ("threshold", po::value<double>(&threshold)->default_value(0), "amplitude threshold before writing to disk")
+        ("saturation-warning", po::value<double>(&saturation_warning)->default_value(0), "threshold value for saturation warning")
+    ;
+    // clang-format on
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << boost::format("Recorder benchmark %s") % desc << std::endl;
+        std::cout << "Records an emulated stream exactly as rx_samples_to_file_buffered records a USRP.\n"
+                     "Unpaced, the run reports the highest rate the writers sustain, e.g.\n"
+                     "  recorder_bench --channels 2 --rate 50e6 --duration 20 --writer direct\n"
+                     "Paced, it checks whether a given rate is sustained, and --overflow-rate exercises the error paths."
+                  << std::endl;
+        return ~0;
+    }
+    double rate = vm["rate"].as<double>();
+
+    std::vector<std::string> replay_files;
+    if (!replay_list.empty()) {
+        boost::split(replay_files, replay_list, boost::is_any_of("\"',"));
+        num_channels = replay_files.size();
+    }
+
+    if (block_ms <= 0 || ring_depth < 2 || (static_cast<long long>(rate) * block_ms) % 1000 != 0
+        || (static_cast<long long>(rate) * block_ms / 1000) % spb != 0) {
+        std::cout << "========= Make sure the block duration is a whole number of samples, SPB divides it, and the ring depth is at least 2. Exiting." << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> folders;
+    for (size_t ch = 0; ch < num_channels; ch++) {
+        std::string subfolder = folder + pathsplit + std::to_string(ch);
+        boost::filesystem::create_directories(subfolder);
+        folders.push_back(subfolder);
+    }
+
+    RecorderOptions options;
+    options.samps_per_buff        = spb;
+    options.num_requested_samples = total_num_samps;
+    options.threshold             = threshold;
+    options.saturation_warning    = saturation_warning;
+    options.time_requested        = total_time;
+    options.bw_summary            = vm.count("progress") > 0;
+    options.stats                 = true;
+    options.null                  = vm.count("null") > 0;
+    options.enable_size_map       = vm.count("sizemap") > 0;
+    options.verbose               = vm.count("verbose") > 0;
+    options.profile               = vm.count("profile") > 0;
+    options.num_writers           = num_writers;
+    options.ring_depth            = ring_depth;
+    options.block_ms              = block_ms;
+    options.writer_backend        = writer_backend;
+    options.capture_base          = capture_name.empty() ? "" : folder + pathsplit + capture_name;
+    options.segment_seconds       = segment_seconds;
+    options.recover               = vm.count("recover") > 0;
+    options.rx_cpus               = vm["rx-cpus"].as<std::string>();
+    options.writer_cpus           = vm["writer-cpus"].as<std::string>();
+    options.dsp_cpus              = vm["dsp-cpus"].as<std::string>();
+    options.rt_priority           = vm["rt-priority"].as<int>();
+    options.channel_nodes         = vm["channel-nodes"].as<std::string>();
+    options.prefault              = vm.count("prefault") > 0;
+    options.debug_fill            = vm["debug-fill"].as<int>();
+    options.gap_log               = folder + pathsplit + "gaps.txt";
+
+    std::signal(SIGINT, &sig_int_handler);
+
+#define run_bench_args(format) \
+    (vm, format, num_channels, folders, replay_files, faults, options)
+
+    if (type == "double")
+        return run_bench<std::complex<double>> run_bench_args("fc64");
+    else if (type == "float")
+        return run_bench<std::complex<float>> run_bench_args("fc32");
+    else if (type == "short")
+        return run_bench<std::complex<short>> run_bench_args("sc16");
+    else if (type == "byte")
+        return run_bench<std::complex<char>> run_bench_args("sc8");
+    throw std::runtime_error("Unknown type " + type);
+}
@@ -23,75 +23,77 @@
 #include <iostream>
 #include <thread>
 
-#ifdef linux
-const char pathsplit = '/';
-#else
-const char pathsplit = '\\';
-#endif
+#include "buffered_recorder.h"
 
 namespace po = boost::program_options;
 
-static bool stop_signal_called = false;
-void sig_int_handler(int)
+/*
+The recorder's view of a USRP: rx_streamer::recv with its metadata translated,
+and streaming commands which start on a whole second of the device time.
+*/
+class UhdSampleSource : public SampleSource
 {
-    stop_signal_called = true;
-}
+public:
+    UhdSampleSource(uhd::usrp::multi_usrp::sptr usrp, uhd::rx_streamer::sptr rx_stream, size_t channel, size_t num_channels)
+        : m_usrp(usrp), m_rx_stream(rx_stream), m_channel(channel), m_num_channels(num_channels) {}
 
-template <typename samp_type>
-void save_to_file(const std::string& folder, long long int second, std::vector<samp_type> &recdata, double threshold, double saturation_warning)
-{
-	char filename[512];
-	snprintf(filename, 512, "%s%c%lld.bin", folder.c_str(), pathsplit, second);
-    // printf("Writing to %s\n", filename);
-	
-    bool toWrite = false;
-    if (threshold > 0)
+    long long start(unsigned long long num_samps) override
     {
-        // check if any values satisfy threshold
-        toWrite = std::any_of(recdata.cbegin(), recdata.cend(), [threshold](samp_type val){return static_cast<double>(std::abs(val)) > threshold;});
-    }
-    else{
-        toWrite = true; // if threshold is 0, always write (default behaviour)
+        uhd::stream_cmd_t stream_cmd((num_samps == 0)
+                                         ? uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS
+                                         : uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+        stream_cmd.num_samps  = size_t(num_samps);
+        stream_cmd.stream_now = false; // don't do immediately but sync to the second
+        uhd::time_spec_t time2send(m_usrp->get_time_now().get_full_secs() + 2, 0.0); // use time_now instead of pps?
+        stream_cmd.time_spec = time2send;
+        m_rx_stream->issue_stream_cmd(stream_cmd);
+        return time2send.get_full_secs();
     }
 
-    // check for saturation if specified
-    if (saturation_warning > 0 && std::any_of(recdata.cbegin(), recdata.cend(), [saturation_warning](samp_type val){return static_cast<double>(std::abs(val)) > saturation_warning;}))
-        printf("Saturated samples found (> %.2f)", saturation_warning);
+    void stop() override
+    {
+        m_rx_stream->issue_stream_cmd(uhd::stream_cmd_t(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS));
+    }
 
-    
-    if (toWrite)
+    size_t recv(const std::vector<void*>& buffs, size_t n, SourceMetadata& md, double timeout, bool one_packet) override
     {
-        FILE *fp = fopen(filename, "wb");
-        if (fp != NULL)
-        {
-            fwrite(recdata.data(), sizeof(samp_type), recdata.size(), fp);
-            fclose(fp);
-            
-            printf("Wrote %s.\n", filename);
+        uhd::rx_metadata_t rx_md;
+        size_t num_rx_samps = m_rx_stream->recv(buffs, n, rx_md, timeout, one_packet);
+
+        // with --recover, the recorder places lost samples by the time spec; otherwise block times come from
+        // the start time and a sample count, as the time spec is not accurate for twinRX
+        md.hasTime   = rx_md.has_time_spec;
+        md.fullSecs  = rx_md.time_spec.get_full_secs();
+        md.fracSecs  = rx_md.time_spec.get_frac_secs();
+        switch (rx_md.error_code) {
+            case uhd::rx_metadata_t::ERROR_CODE_NONE:     md.error = SourceMetadata::NONE; break;
+            case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:  md.error = SourceMetadata::TIMEOUT; break;
+            case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW: md.error = SourceMetadata::OVERFLOW; break;
+            default:                                      md.error = SourceMetadata::OTHER; break;
         }
+        md.errorString = md.error == SourceMetadata::NONE ? "" : rx_md.strerror();
+        return num_rx_samps;
     }
-	
-}
+
+    double rate() const override { return m_usrp->get_rx_rate(m_channel); }
+    size_t numChannels() const override { return m_num_channels; }
+    std::string description() const override { return m_usrp->get_pp_string(); }
+
+private:
+    uhd::usrp::multi_usrp::sptr m_usrp;
+    uhd::rx_streamer::sptr m_rx_stream;
+    size_t m_channel;
+    size_t m_num_channels;
+};
 
 template <typename samp_type>
 void recv_to_file(uhd::usrp::multi_usrp::sptr usrp,
     const std::string& cpu_format,
     const std::string& wire_format,
     std::vector<size_t> &channel_nums,
-
-    size_t samps_per_buff,
-    unsigned long long num_requested_samples,
     std::vector<std::string> &folders,
-    double threshold            = 0,
-    double saturation_warning   = 0,
-    double time_requested       = 0.0,
-    bool bw_summary             = false,
-    bool stats                  = false,
-    bool null                   = false,
-    bool enable_size_map        = false,
-    bool verbose                = false)
+    const RecorderOptions& options)
 {
-    unsigned long long num_total_samps = 0;
     // create a receive streamer
     uhd::stream_args_t stream_args(cpu_format, wire_format);
     std::cout << "cpu_format: " << cpu_format << " wire_format: " << wire_format << std::endl;
@@ -155,182 +157,10 @@ void recv_to_file(uhd::usrp::multi_usrp::sptr usrp,
         std::cout << "Not configured for non-internal/gpsdo sources yet!" << std::endl;
     }
 
-    uhd::rx_metadata_t md;
-	int rx_rate = static_cast<int>(round(usrp->get_rx_rate(channel_nums[0])));
-	std::cout << "======= Using 1 second buffers (x2) of " << rx_rate << " length." << std::endl;
-	// First make the actual buffers for each channel, x2 
-    std::vector<std::vector<samp_type>> buffs[2]; // at the start, buffs[0] will be used, then buffs[1] after 1 second, and alternating thenceforth
-	buffs[0].resize(channel_nums.size());
-	buffs[1].resize(channel_nums.size());
-	for (int ch = 0; ch < channel_nums.size(); ch++){
-		// Reserve+resize buff1
-		buffs[0].at(ch).reserve(rx_rate);
-		buffs[0].at(ch).resize(rx_rate);
-		memset(&buffs[0].at(ch).front(), 0, sizeof(samp_type) * buffs[0].at(ch).size()); // let's zero it for debugging purposes
-		// Reserve+resize buff2
-		buffs[1].at(ch).reserve(rx_rate);
-		buffs[1].at(ch).resize(rx_rate);
-		memset(&buffs[1].at(ch).front(), 0, sizeof(samp_type) * buffs[1].at(ch).size()); // let's zero it for debugging purposes
-	}
-	// Now create the pointer vectors, one for current, one for waiting
-	std::vector<samp_type*> buff_ptrs[2];
-	buff_ptrs[0].resize(channel_nums.size());
-	buff_ptrs[1].resize(channel_nums.size()); // we will be writing the pointers during the loop, not here
-
-	int tIdx = 0; // used for buffer index, 0 or 1
-	int bufIdx = 0; // used to index into the vector
-
-    bool overflow_message = true;
-
-    // setup streaming
-    uhd::stream_cmd_t stream_cmd((num_requested_samples == 0)
-                                     ? uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS
-                                     : uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
-    stream_cmd.num_samps  = size_t(num_requested_samples);
-    stream_cmd.stream_now = false; // don't do immediately but sync to the second
-	uhd::time_spec_t time2send(usrp->get_time_now().get_full_secs() + 2, 0.0); // use time_now instead of pps?
-    stream_cmd.time_spec = time2send;
-	printf("Streaming will start at %lld\n", time2send.get_full_secs());
-    rx_stream->issue_stream_cmd(stream_cmd);
-
-    typedef std::map<size_t, size_t> SizeMap;
-    SizeMap mapSizes;
-    const auto start_time = std::chrono::steady_clock::now();
-    const auto stop_time =
-        start_time + std::chrono::milliseconds(int64_t(1000 * time_requested));
-    // Track time and samps between updating the BW summary
-    auto last_update                     = start_time;
-    unsigned long long last_update_samps = 0;
-
-	// metadata holding
-	uhd::time_spec_t rxtime;
-	
-	// counter of numFiles so far
-	int64_t numFilesWritten = 0;
-	
-    // Run this loop until either time expired (if a duration was given), until
-    // the requested number of samples were collected (if such a number was
-    // given), or until Ctrl-C was pressed.
-    while (not stop_signal_called
-           and (num_requested_samples != num_total_samps or num_requested_samples == 0)
-           and (time_requested == 0.0 or std::chrono::steady_clock::now() <= stop_time)) {
-        const auto now = std::chrono::steady_clock::now();
-
-		// write the vector of pointers before receiving (only need to write the buff_ptrs at tIdx)	
-		for (size_t i = 0; i < channel_nums.size(); i++){
-			buff_ptrs[tIdx].at(i) = &buffs[tIdx].at(i).at(bufIdx);
-		}
-		// perform the receive
-        size_t num_rx_samps =
-            // rx_stream->recv(&buff[tIdx].at(bufIdx), samps_per_buff, md, 3.0, enable_size_map); // we edit to write at bufIdx
-			rx_stream->recv(buff_ptrs[tIdx], samps_per_buff, md, 3.0, enable_size_map); // we edit to write at bufIdx
-		
-		// =========== read the metadata
-		// std::cout << md.to_pp_string(false) << std::endl;
-		rxtime = md.time_spec;
-//		printf("Sec : %lld, frac sec : %.11f, samples: %zd\n", rxtime.get_full_secs(), rxtime.get_frac_secs(), num_rx_samps);
-//		printf("Tick Count: %ld. \n", rxtime.get_tick_count(200e6));
-//        uhd::time_spec_t timenow = usrp->get_time_now();
-//        printf("Time from USRP: %lld, frac sec: %.11f\n", timenow.get_full_secs(), timenow.get_frac_secs()); // this line shows that the TwinRX appears to be doubling the duration (maybe because two DSPs and they added by accident? either way, using the metadata will be incorrect for the twinRX)
-		// ============================
-		
-        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT) {
-            std::cout << boost::format("Timeout while streaming") << std::endl;
-            break;
-        }
-        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) {
-            if (overflow_message) {
-                overflow_message = false;
-                std::cerr
-                    << boost::format(
-                           "Got an overflow indication. Please consider the following:\n"
-                           "  Your write medium must sustain a rate of %fMB/s.\n"
-                           "  Dropped samples will not be written to the file.\n"
-                           "  Please modify this example for your purposes.\n"
-                           "  This message will not appear again.\n")
-                           % (usrp->get_rx_rate(channel_nums[0]) * sizeof(samp_type) / 1e6);
-            }
-            // continue;
-			break; // we want to ensure timing integrity, so if overflow let's end
-        }
-        if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE) {
-            std::string error = str(boost::format("Receiver error: %s") % md.strerror());
-//            if (continue_on_bad_packet) {
-//                std::cerr << error << std::endl;
-//                continue;
-//            } else
-//                throw std::runtime_error(error);
-            break; // again, ensure timing integrity, always break
-        }
-
-        if (enable_size_map) {
-            SizeMap::iterator it = mapSizes.find(num_rx_samps);
-            if (it == mapSizes.end())
-                mapSizes[num_rx_samps] = 0;
-            mapSizes[num_rx_samps] += 1;
-        }
-
-        num_total_samps += num_rx_samps;
-
-		// ============ check buffers
-		if (verbose) {printf("Buf: %d. W: %d\n", tIdx, bufIdx);}
-		// update the new idx to write to
-		bufIdx = bufIdx + num_rx_samps;
-		if (bufIdx == rx_rate) // then move to next buffer
-		{
-			// start thread to write current buffer, for each subfolder
-			for (int i = 0; i < folders.size(); i++){
-//				std::thread t(save_to_file<samp_type>, std::ref(folders.at(i)), rxtime.get_full_secs(), std::ref(buffs[tIdx].at(i)), threshold); // since rxtime is not accurate for twinRX, we revert to just a plain counter based on start timing
-                std::thread t(save_to_file<samp_type>, std::ref(folders.at(i)), time2send.get_full_secs() + numFilesWritten, std::ref(buffs[tIdx].at(i)), threshold, saturation_warning); 
-
-				t.detach();
-			}
-			
-			// update indices
-			tIdx = (tIdx + 1) % 2;
-			bufIdx = 0;
-			
-			numFilesWritten += 1;
-		}
-		// ==========================
-		
-        if (bw_summary) {
-            last_update_samps += num_rx_samps;
-            const auto time_since_last_update = now - last_update;
-            if (time_since_last_update > std::chrono::seconds(1)) {
-                const double time_since_last_update_s =
-                    std::chrono::duration<double>(time_since_last_update).count();
-                const double rate = double(last_update_samps) / time_since_last_update_s;
-                std::cout << "\t" << (rate / 1e6) << " Msps" << std::endl;
-                last_update_samps = 0;
-                last_update       = now;
-            }
-        }
-    }
-    const auto actual_stop_time = std::chrono::steady_clock::now();
-
-    stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
-    rx_stream->issue_stream_cmd(stream_cmd);
-
-
-    if (stats) {
-        std::cout << std::endl;
-        const double actual_duration_seconds =
-            std::chrono::duration<float>(actual_stop_time - start_time).count();
-
-        std::cout << boost::format("Received %d samples in %f seconds") % num_total_samps
-                         % actual_duration_seconds
-                  << std::endl;
-        const double rate = (double)num_total_samps / actual_duration_seconds;
-        std::cout << (rate / 1e6) << " Msps" << std::endl;
-
-        if (enable_size_map) {
-            std::cout << std::endl;
-            std::cout << "Packet size map (bytes: count)" << std::endl;
-            for (SizeMap::iterator it = mapSizes.begin(); it != mapSizes.end(); it++)
-                std::cout << it->first << ":\t" << it->second << std::endl;
-        }
-    }
+    RecorderOptions recorder_options = options;
+    recorder_options.cpu_format = cpu_format; // labels capture files
+    UhdSampleSource source(usrp, rx_stream, channel_nums[0], channel_nums.size());
+    record_to_files<samp_type>(source, channel_nums, folders, recorder_options);
 }
 
 typedef std::function<uhd::sensor_value_t(const std::string&)> get_sensor_fn_t;
@@ -380,12 +210,13 @@ bool check_locked_sensor(std::vector<std::string> sensor_names,
 int UHD_SAFE_MAIN(int argc, char* argv[])
 {
     // variables to be set by po
-    std::string args, file, type, ant, subdev, ref, wirefmt, folder;
+    std::string args, file, type, ant, subdev, ref, wirefmt, folder, writer_backend, capture_name;
 	std::string channel_list, ant_list;
     std::string freqstr_list;
-    size_t channel, total_num_samps, spb;
+    size_t channel, total_num_samps, spb, num_writers, ring_depth;
+    int block_ms;
     double rate, freq, gain, bw, total_time, setup_time, lo_offset;
-    double threshold, saturation_warning;
+    double threshold, saturation_warning, segment_seconds;
 
     // setup the program options
     po::options_description desc("Allowed options");
@@ -422,6 +253,21 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         ("skip-lo", "skip checking LO lock status")
         ("int-n", "tune USRP with integer-N tuning")
         ("verbose", "turn on verbose reporting")
+        ("profile", "print a breakdown of where the receive loop spends each second")
+        ("rx-cpus", po::value<std::string>()->default_value(""), "cores for the receive thread, e.g. \"2\", \"2-3\" or \"node:0\" for every core of NUMA node 0")
+        ("writer-cpus", po::value<std::string>()->default_value(""), "cores to spread the writer threads over, one each")
+        ("dsp-cpus", po::value<std::string>()->default_value(""), "cores to spread the processing threads (writer dispatch, monitor) over, one each")
+        ("rt-priority", po::value<int>()->default_value(0), "SCHED_FIFO priority for the receive thread (1-99, needs CAP_SYS_NICE or an rtprio limit), 0 for none")
+        ("channel-nodes", po::value<std::string>()->default_value(""), "NUMA node for each channel's buffers, e.g. \"0,1\" (-1 for no preference); put the writers on the same nodes with --writer-cpus")
+        ("prefault", "fault in all buffer memory before streaming starts, so the first second doesn't pay for page faults")
+        ("debug-fill", po::value<int>()->default_value(-1), "fill the buffers with this byte value before streaming, to spot samples never written (-1 to leave them uninitialised)")
+        ("recover", "on overflows and receiver errors, zero-fill the lost samples (from the metadata timestamps) and keep recording, listing the gaps in <folder>/gaps.txt (needs accurate timestamps, so not for TwinRX)")
+        ("writers", po::value<size_t>(&num_writers)->default_value(0), "number of file writer threads (0 for one per channel)")
+        ("ring-depth", po::value<size_t>(&ring_depth)->default_value(2), "number of blocks buffered per channel while they are written")
+        ("block-ms", po::value<int>(&block_ms)->default_value(1000), "duration of each block (and file) in milliseconds")
+        ("writer", po::value<std::string>(&writer_backend)->default_value("stdio"), "file writing backend: stdio, direct (O_DIRECT, preallocated) or io_uring (Linux only)")
+        ("capture-file", po::value<std::string>(&capture_name)->default_value(""), "write all channels into preallocated segmented capture files <folder>/<name>_<segment>.iqc instead of a file per block (Linux only)")
+        ("segment-seconds", po::value<double>(&segment_seconds)->default_value(3600), "duration held by each capture file segment")
 		("folder", po::value<std::string>(&folder)->default_value(""), "path to write files to (will be created if it doesn't exist)")
         ("threshold", po::value<double>(&threshold)->default_value(0), "amplitude threshold before writing to disk")
         ("saturation-warning", po::value<double>(&saturation_warning)->default_value(0), "threshold value for saturation warning (any sample whose abs value exceeds this will produce a warning)")
@@ -464,7 +310,7 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         std::cout << boost::format("UHD RX samples to file %s") % desc << std::endl;
         std::cout << std::endl
                   << "This application streams data from multiple channels of a USRP "
-                     "device to multiple 1 second files. Combination examples:\n"
+                     "device to multiple 1 second files (or --block-ms long files). Combination examples:\n"
 					 "--channels 0,1 --ants TX/RX,RX2 \n"
 					 "will use channel 0 (usually left half of USRP) with TX/RX port, and channel 1 (right half) with RX2 port.\n"
 					 "If --ants is not specified, all channels default to the RX2 port.\n"
@@ -510,6 +356,7 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
     bool enable_size_map        = vm.count("sizemap") > 0;
     bool continue_on_bad_packet = vm.count("continue") > 0;
     bool verbose                = vm.count("verbose") > 0;
+    bool profile                = vm.count("profile") > 0;
 
     if (enable_size_map)
         std::cout << "Packet size tracking enabled - will only recv one packet at a time!"
@@ -664,13 +511,22 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
 		
     } // end of channel loop
 
-	// check that samples per buffer is a divisor of sample rate
-	if (static_cast<int>(rate) % spb != 0)
+	// check that samples per buffer is a divisor of the block length
+	if (block_ms <= 0 || ring_depth < 2 || (static_cast<long long>(rate) * block_ms) % 1000 != 0)
 	{
-		std::cout << "========= Make sure SPB is a divisor of sample rate. Exiting." << std::endl;
+		std::cout << "========= Make sure the block duration is a whole number of samples, and the ring depth is at least 2. Exiting." << std::endl;
+		return -1;
+	}
+	if ((static_cast<long long>(rate) * block_ms / 1000) % spb != 0)
+	{
+		std::cout << "========= Make sure SPB is a divisor of the samples per block. Exiting." << std::endl;
 		return -1;
 	}
 
+    std::string capture_path = capture_name.empty() ? "" : folder + pathsplit + capture_name;
+    if (channel_nums.size() > CaptureFileHeader::MAX_CHANNELS && !capture_path.empty())
+        throw std::runtime_error("Capture files hold at most 32 channels.");
+
     if (total_num_samps == 0) {
         std::signal(SIGINT, &sig_int_handler);
         std::cout << "Press Ctrl + C to stop streaming..." << std::endl;
@@ -678,22 +534,41 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
 	
 	
 
+    RecorderOptions options;
+    options.samps_per_buff        = spb;
+    options.num_requested_samples = total_num_samps;
+    options.threshold             = threshold;
+    options.saturation_warning    = saturation_warning;
+    options.time_requested        = total_time;
+    options.bw_summary            = bw_summary;
+    options.stats                 = stats;
+    options.null                  = null;
+    options.enable_size_map       = enable_size_map;
+    options.verbose               = verbose;
+    options.profile               = profile;
+    options.num_writers           = num_writers;
+    options.ring_depth            = ring_depth;
+    options.block_ms              = block_ms;
+    options.writer_backend        = writer_backend;
+    options.capture_base          = capture_path;
+    options.segment_seconds       = segment_seconds;
+    options.recover               = vm.count("recover") > 0;
+    options.rx_cpus               = vm["rx-cpus"].as<std::string>();
+    options.writer_cpus           = vm["writer-cpus"].as<std::string>();
+    options.dsp_cpus              = vm["dsp-cpus"].as<std::string>();
+    options.rt_priority           = vm["rt-priority"].as<int>();
+    options.channel_nodes         = vm["channel-nodes"].as<std::string>();
+    options.prefault              = vm.count("prefault") > 0;
+    options.debug_fill            = vm["debug-fill"].as<int>();
+    options.gap_log               = folder + pathsplit + "gaps.txt";
+
 #define recv_to_file_args(format) \
     (usrp,                        \
         format,                   \
         wirefmt,                  \
         channel_nums,             \
-        spb,                      \
-        total_num_samps,          \
         folders,                  \
-        threshold,                \
-        saturation_warning,       \
-        total_time,               \
-        bw_summary,               \
-        stats,                    \
-        null,                     \
-        enable_size_map,          \
-        verbose)
+        options)
     // recv to file
     
     do{
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// from numaif.h, without needing libnuma
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+#ifndef MPOL_F_NODE
+#define MPOL_F_NODE (1 << 0)
+#define MPOL_F_ADDR (1 << 1)
+#endif
+#endif
+
+#include "writer_pool.h"
+
+/*
+One page-aligned allocation, backed by hugepages where the system allows it.
+On Linux this tries explicit hugepages (MAP_HUGETLB, needs vm.nr_hugepages), then transparent
+hugepages through madvise, then plain pages. Elsewhere it is just page-aligned heap memory.
+The memory is never initialised here; with populate, its pages are faulted in up front (as zeros)
+so the first pass over them doesn't take a page fault every 4k.
+*/
+class AlignedRegion
+{
+public:
+    static const size_t PAGE = 4096;
+    static const size_t HUGEPAGE = 2 * 1024 * 1024;
+
+    AlignedRegion(size_t bytes, bool hugepages = true, bool populate = false)
+    {
+#ifdef __linux__
+        if (hugepages){
+            m_bytes = roundUp(bytes, HUGEPAGE);
+            m_data = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (populate ? MAP_POPULATE : 0), -1, 0);
+            if (m_data != MAP_FAILED){
+                m_backing = "hugetlb pages";
+                return;
+            }
+        }
+        m_bytes = roundUp(bytes, hugepages ? HUGEPAGE : PAGE);
+        // mmap only aligns to 4k, and THP can only back a hugepage-aligned range, so map a hugepage
+        // more than needed and unmap the slack either side of the aligned part
+        size_t slack = hugepages ? HUGEPAGE : 0;
+        void* mapped = mmap(nullptr, m_bytes + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::bad_alloc();
+        char* base = static_cast<char*>(mapped);
+        char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(base), hugepages ? HUGEPAGE : PAGE));
+        size_t head = aligned - base;
+        if (head > 0)
+            munmap(base, head);
+        if (slack > head)
+            munmap(aligned + m_bytes, slack - head);
+        m_data = aligned;
+        m_backing = "4k pages";
+        if (hugepages && madvise(m_data, m_bytes, MADV_HUGEPAGE) == 0)
+            m_backing = "transparent hugepages";
+        // only now, as MAP_POPULATE would have faulted in 4k pages before the madvise
+        if (populate)
+            prefault();
+#else
+        m_bytes = roundUp(bytes, PAGE);
+#ifdef _MSC_VER
+        m_data = _aligned_malloc(m_bytes, PAGE);
+#else
+        m_data = aligned_alloc(PAGE, m_bytes);
+#endif
+        if (m_data == nullptr)
+            throw std::bad_alloc();
+        m_backing = "heap";
+#endif
+    }
+
+    ~AlignedRegion()
+    {
+        if (m_data == nullptr)
+            return;
+#ifdef __linux__
+        munmap(m_data, m_bytes);
+#elif defined(_MSC_VER)
+        _aligned_free(m_data);
+#else
+        free(m_data);
+#endif
+    }
+
+    AlignedRegion(const AlignedRegion&) = delete;
+    AlignedRegion& operator=(const AlignedRegion&) = delete;
+
+    void* data() const { return m_data; }
+    size_t size() const { return m_bytes; }
+    const char* backing() const { return m_backing; }
+
+    /*
+    Asks for the pages in [offset, offset + bytes) to come from NUMA node node (through mbind, preferred rather than
+    strict, so a full node falls back to the others instead of failing). Pages already touched are moved.
+    The range should be page aligned, and hugepage aligned for hugepage backing.
+    Only nodes 0-63 can be asked for (the mask is a single word).
+    Returns an error message, empty on success.
+    */
+    std::string bindToNode(size_t offset, size_t bytes, int node)
+    {
+#ifdef __linux__
+        if (node < 0 || node >= 64)
+            return "NUMA node " + std::to_string(node) + " is out of range";
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_mbind, static_cast<char*>(m_data) + offset, bytes, MPOL_PREFERRED, &mask, 64 + 1, MPOL_MF_MOVE) != 0)
+            return "could not bind to NUMA node " + std::to_string(node) + ": " + strerror(errno);
+        return "";
+#else
+        (void)offset; (void)bytes; (void)node;
+        return "NUMA binding is only supported on Linux";
+#endif
+    }
+
+    // faults every page in, without changing its contents
+    void prefault()
+    {
+#ifdef __linux__
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+        if (madvise(m_data, m_bytes, MADV_POPULATE_WRITE) == 0)
+            return;
+#endif
+        // (before Linux 5.14) the pages are still untouched, so rewriting a byte of each allocates it unchanged
+        volatile char* p = static_cast<char*>(m_data);
+        for (size_t i = 0; i < m_bytes; i += PAGE)
+            p[i] = p[i];
+    }
+
+    // the node holding the one page at offset (faulting it in if it wasn't yet), or -1 if unknown;
+    // the rest of a range can sit elsewhere, e.g. where a preferred node ran out of memory
+    int nodeOf(size_t offset) const
+    {
+#ifdef __linux__
+        int node = -1;
+        if (syscall(SYS_get_mempolicy, &node, NULL, 0, static_cast<char*>(m_data) + offset, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+            return -1;
+        return node;
+#else
+        (void)offset;
+        return -1;
+#endif
+    }
+
+    static size_t roundUp(size_t bytes, size_t multiple)
+    {
+        return (bytes + multiple - 1) / multiple * multiple;
+    }
+
+private:
+    void* m_data = nullptr;
+    size_t m_bytes = 0;
+    const char* m_backing = "";
+};
+
+/*
+Ring of depth slots, each holding one block of blockSamples samples for every channel, in one AlignedRegion.
+Every channel's block starts on a page boundary, and each channel's blocks are contiguous (and start on a
+hugepage boundary with hugepages), so that a channel can be placed on its own NUMA node with channelNodes
+(one node per channel, -1 to leave a channel to the default policy).
+
+A slot is owned by the receiver until it is handed off to the writers, and only comes back
+once every writer has released it; acquire() waits for that before the receiver reuses the slot.
+
+Example:
+    SampleRing<std::complex<short>> ring(8, channels, rate / 4); // 8 x 250 ms
+    ring.acquire(slot);                      // wait for the writers to give it back
+    ... recv into ring.block(slot, ch) ...
+    ring.handOff(slot, channels);            // then each writer calls ring.release(slot)
+*/
+template <typename samp_type>
+class SampleRing
+{
+public:
+    SampleRing(size_t depth, size_t numChannels, size_t blockSamples, bool hugepages = true,
+               const std::vector<int>& channelNodes = std::vector<int>(), bool prefault = false, int debugFill = -1)
+        : m_depth(depth), m_numChannels(numChannels), m_blockSamples(blockSamples),
+          m_stride(AlignedRegion::roundUp(blockSamples * sizeof(samp_type), AlignedRegion::PAGE)),
+          m_channelBytes(AlignedRegion::roundUp(depth * m_stride, hugepages ? AlignedRegion::HUGEPAGE : AlignedRegion::PAGE)),
+          m_region(numChannels * m_channelBytes, hugepages, prefault && channelNodes.empty()),
+          m_returns(new BufferReturn[depth])
+    {
+        // before anything touches the pages, so they are first allocated where they belong
+        for (size_t ch = 0; ch < channelNodes.size() && ch < numChannels; ch++){
+            if (channelNodes[ch] < 0)
+                continue;
+            std::string err = m_region.bindToNode(ch * m_channelBytes, m_channelBytes, channelNodes[ch]);
+            if (!err.empty())
+                fprintf(stderr, "======= Warning: channel %zu buffers %s\n", ch, err.c_str());
+        }
+        if (prefault && !channelNodes.empty())
+            m_region.prefault();
+        // Nothing is zeroed: a block is only handed off once recv has filled all of it.
+        // A fill pattern is only for spotting samples that were never written, when debugging.
+        if (debugFill >= 0)
+            memset(m_region.data(), debugFill & 0xFF, m_region.size());
+    }
+
+    samp_type* block(size_t slot, size_t channel)
+    {
+        return reinterpret_cast<samp_type*>(static_cast<char*>(m_region.data()) + channel * m_channelBytes + slot * m_stride);
+    }
+
+    // the NUMA node actually holding the first page of a channel's buffers, or -1 if unknown
+    int channelNode(size_t channel) const { return m_region.nodeOf(channel * m_channelBytes); }
+
+    // returns the time spent waiting for the writers to give the slot back
+    double acquire(size_t slot) { return m_returns[slot].wait(); }
+    void handOff(size_t slot, int writers) { m_returns[slot].hold(writers); }
+    void release(size_t slot) { m_returns[slot].release(); }
+
+    size_t depth() const { return m_depth; }
+    size_t numChannels() const { return m_numChannels; }
+    size_t blockSamples() const { return m_blockSamples; }
+    const AlignedRegion& region() const { return m_region; }
+
+private:
+    size_t m_depth;
+    size_t m_numChannels;
+    size_t m_blockSamples;
+    size_t m_stride;       // bytes between the blocks of a channel
+    size_t m_channelBytes; // bytes between channels
+    AlignedRegion m_region;
+    std::unique_ptr<BufferReturn[]> m_returns;
+};
@@ -0,0 +1,448 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+What the recorder needs from a receive streamer, so that the recording pipeline can run
+against a USRP (through an adapter around uhd::rx_streamer) or against the emulated sources below.
+*/
+struct SourceMetadata
+{
+    enum ErrorCode { NONE, TIMEOUT, OVERFLOW, OTHER };
+
+    ErrorCode error = NONE;
+    bool hasTime = false;
+    long long fullSecs = 0;  // time of the first sample returned (or where the stream resumes, after an overflow)
+    double fracSecs = 0;
+    std::string errorString;
+};
+
+class SampleSource
+{
+public:
+    virtual ~SampleSource() {}
+
+    // begins streaming numSamples (0 for continuous) from the start of the returned second
+    virtual long long start(unsigned long long numSamples) = 0;
+    virtual void stop() = 0;
+
+    // as rx_streamer::recv: up to n samples into each channel's buffer, or a single packet's worth with onePacket
+    virtual size_t recv(const std::vector<void*>& buffs, size_t n, SourceMetadata& md, double timeout, bool onePacket) = 0;
+
+    virtual double rate() const = 0;
+    virtual size_t numChannels() const = 0;
+    virtual std::string description() const = 0;
+};
+
+// faults injected by the emulated sources, at random packets with the given average rates
+struct SourceFaults
+{
+    double overflowsPerSecond = 0;  // per second of stream, not of wall time
+    size_t overflowSamples = 0;     // samples lost in each overflow (one packet if 0)
+    double timeoutsPerSecond = 0;
+    unsigned long long seed = 1;
+};
+
+struct SourceStats
+{
+    unsigned long long samples = 0;      // delivered to the caller
+    unsigned long long packets = 0;
+    unsigned long long overflows = 0;    // injected, or from falling behind when paced
+    unsigned long long samplesLost = 0;
+    unsigned long long timeouts = 0;
+};
+
+/*
+Emulates rx_streamer::recv for a stream of rate samples/s on numChannels channels, delivered in
+packets of packetSamples, with a timestamp on every call and the faults above.
+Subclasses only fill in the sample values.
+
+Paced, samples become available in real time from the start second, and a caller that falls more than
+bufferSeconds behind gets an overflow and loses everything older, like a device whose buffer has filled up.
+Unpaced, every recv returns at once, so the rate the caller keeps up is the rate of the pipeline behind it.
+*/
+class EmulatedSource : public SampleSource
+{
+public:
+    EmulatedSource(double rate, size_t numChannels, size_t sampleBytes, size_t packetSamples, bool paced,
+                   const SourceFaults& faults = SourceFaults(), double bufferSeconds = 0.1)
+        : m_rate(rate), m_numChannels(numChannels), m_sampleBytes(sampleBytes),
+          m_packetSamples(packetSamples > 0 ? packetSamples : 2000), m_paced(paced), m_faults(faults),
+          m_bufferSamples(static_cast<unsigned long long>(rate * bufferSeconds)), m_rng(faults.seed)
+    {
+        if (rate <= 0 || numChannels == 0)
+            throw std::invalid_argument("EmulatedSource needs a positive rate and at least one channel");
+    }
+
+    long long start(unsigned long long numSamples) override
+    {
+        // like the recorder's USRP start, on a whole second with some lead time
+        auto now = std::chrono::system_clock::now();
+        double nowSecs = std::chrono::duration<double>(now.time_since_epoch()).count();
+        m_startSecond = static_cast<long long>(nowSecs) + (m_paced ? 2 : 1);
+        m_startTime = std::chrono::steady_clock::now()
+                      + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_startSecond - nowSecs));
+        m_limit = numSamples;
+        m_position = 0;
+        m_pending = SourceMetadata::NONE;
+        m_running = true;
+        return m_startSecond;
+    }
+
+    void stop() override { m_running = false; }
+
+    size_t recv(const std::vector<void*>& buffs, size_t n, SourceMetadata& md, double timeout, bool onePacket) override
+    {
+        md = SourceMetadata();
+        if (buffs.size() < m_numChannels)
+            throw std::invalid_argument("recv needs a buffer for every channel");
+
+        setTime(md);
+        size_t got = 0;
+        while (got < n)
+        {
+            if (!m_running || (m_limit != 0 && m_position >= m_limit)){
+                if (got == 0)
+                    return fail(md, SourceMetadata::TIMEOUT, "stream finished");
+                break;
+            }
+            size_t len = std::min(m_packetSamples, n - got);
+            if (m_limit != 0)
+                len = static_cast<size_t>(std::min<unsigned long long>(len, m_limit - m_position));
+
+            // faults belong to the next packet, so a partly filled buffer is returned first
+            if (m_pending == SourceMetadata::NONE)
+                drawFault(len);
+            if (m_pending == SourceMetadata::NONE && m_paced)
+                pace(len, timeout);
+            if (m_pending != SourceMetadata::NONE){
+                if (got > 0)
+                    break;
+                return raisePending(md);
+            }
+
+            std::vector<void*> at(m_numChannels);
+            for (size_t ch = 0; ch < m_numChannels; ch++)
+                at[ch] = static_cast<char*>(buffs[ch]) + got * m_sampleBytes;
+            fill(at, m_position, len);
+
+            m_position += len;
+            got += len;
+            m_stats.packets++;
+            if (onePacket)
+                break;
+        }
+        m_stats.samples += got;
+        return got;
+    }
+
+    double rate() const override { return m_rate; }
+    size_t numChannels() const override { return m_numChannels; }
+    size_t packetSamples() const { return m_packetSamples; }
+    bool paced() const { return m_paced; }
+    const SourceStats& stats() const { return m_stats; }
+
+protected:
+    // writes len samples of each channel, starting from sample number position of the stream
+    virtual void fill(const std::vector<void*>& buffs, unsigned long long position, size_t len) = 0;
+
+    // stops the stream after this many samples, e.g. at the end of a file (0 for no limit)
+    void limitSamples(unsigned long long limit)
+    {
+        if (limit != 0 && (m_limit == 0 || limit < m_limit))
+            m_limit = limit;
+    }
+
+private:
+    double m_rate;
+    size_t m_numChannels;
+    size_t m_sampleBytes;
+    size_t m_packetSamples;
+    bool m_paced;
+    SourceFaults m_faults;
+    unsigned long long m_bufferSamples;
+    std::mt19937_64 m_rng;
+
+    long long m_startSecond = 0;
+    std::chrono::steady_clock::time_point m_startTime;
+    unsigned long long m_limit = 0;
+    unsigned long long m_position = 0; // next sample of the stream to deliver
+    bool m_running = false;
+
+    SourceMetadata::ErrorCode m_pending = SourceMetadata::NONE;
+    unsigned long long m_pendingLoss = 0;
+    SourceStats m_stats;
+
+    void setTime(SourceMetadata& md) const
+    {
+        unsigned long long rate = static_cast<unsigned long long>(m_rate);
+        md.hasTime = true;
+        if (static_cast<double>(rate) == m_rate){
+            md.fullSecs = m_startSecond + static_cast<long long>(m_position / rate);
+            md.fracSecs = static_cast<double>(m_position % rate) / m_rate;
+        }
+        else {
+            double t = m_position / m_rate;
+            md.fullSecs = m_startSecond + static_cast<long long>(t);
+            md.fracSecs = t - std::floor(t);
+        }
+    }
+
+    size_t fail(SourceMetadata& md, SourceMetadata::ErrorCode error, const char* what)
+    {
+        md.error = error;
+        md.errorString = what;
+        return 0;
+    }
+
+    void drawFault(size_t len)
+    {
+        double seconds = len / m_rate;
+        if (m_faults.overflowsPerSecond > 0
+            && std::uniform_real_distribution<double>(0, 1)(m_rng) < m_faults.overflowsPerSecond * seconds){
+            m_pending = SourceMetadata::OVERFLOW;
+            m_pendingLoss = m_faults.overflowSamples > 0 ? m_faults.overflowSamples : m_packetSamples;
+        }
+        else if (m_faults.timeoutsPerSecond > 0
+            && std::uniform_real_distribution<double>(0, 1)(m_rng) < m_faults.timeoutsPerSecond * seconds){
+            m_pending = SourceMetadata::TIMEOUT;
+        }
+    }
+
+    // waits for the packet to exist, or notices that the device buffer would have overflowed
+    void pace(size_t len, double timeout)
+    {
+        auto available = [this](){
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+            return elapsed > 0 ? static_cast<unsigned long long>(elapsed * m_rate) : 0ULL;
+        };
+        unsigned long long avail = available();
+        if (avail > m_position + m_bufferSamples){
+            m_pending = SourceMetadata::OVERFLOW;
+            m_pendingLoss = avail - m_position;
+            return;
+        }
+        if (avail >= m_position + len)
+            return;
+
+        auto due = m_startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                     std::chrono::duration<double>((m_position + len) / m_rate));
+        auto deadline = std::chrono::steady_clock::now()
+                        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+        if (due > deadline){
+            std::this_thread::sleep_until(deadline);
+            m_pending = SourceMetadata::TIMEOUT;
+            return;
+        }
+        std::this_thread::sleep_until(due);
+    }
+
+    size_t raisePending(SourceMetadata& md)
+    {
+        SourceMetadata::ErrorCode error = m_pending;
+        m_pending = SourceMetadata::NONE;
+        if (error == SourceMetadata::OVERFLOW){
+            // the lost samples are skipped, and the metadata says where the stream picks up again
+            m_position += m_pendingLoss;
+            m_stats.overflows++;
+            m_stats.samplesLost += m_pendingLoss;
+            setTime(md);
+            return fail(md, error, "overflow");
+        }
+        m_stats.timeouts++;
+        return fail(md, error, "timeout");
+    }
+};
+
+namespace sample_source_detail
+{
+    template <typename T> struct FullScale
+    {
+        static double value() { return std::is_integral<T>::value ? static_cast<double>(std::numeric_limits<T>::max()) : 1.0; }
+    };
+
+    template <typename T> inline T fromDouble(double re, double) { return static_cast<T>(std::lround(re)); }
+    template <> inline float fromDouble<float>(double re, double) { return static_cast<float>(re); }
+    template <> inline double fromDouble<double>(double re, double) { return re; }
+    template <> inline std::complex<float> fromDouble<std::complex<float>>(double re, double im) { return std::complex<float>((float)re, (float)im); }
+    template <> inline std::complex<double> fromDouble<std::complex<double>>(double re, double im) { return std::complex<double>(re, im); }
+    template <> inline std::complex<short> fromDouble<std::complex<short>>(double re, double im)
+    {
+        return std::complex<short>((short)std::lround(re), (short)std::lround(im));
+    }
+    template <> inline std::complex<char> fromDouble<std::complex<char>>(double re, double im)
+    {
+        return std::complex<char>((char)std::lround(re), (char)std::lround(im));
+    }
+
+    template <typename T> struct Component { typedef T type; };
+    template <typename T> struct Component<std::complex<T>> { typedef T type; };
+
+    // 64-bit file offsets
+    inline int seek(FILE* fp, long long offset, int whence)
+    {
+#ifdef _MSC_VER
+        return _fseeki64(fp, offset, whence);
+#else
+        return fseeko(fp, static_cast<off_t>(offset), whence);
+#endif
+    }
+
+    inline long long tell(FILE* fp)
+    {
+#ifdef _MSC_VER
+        return _ftelli64(fp);
+#else
+        return static_cast<long long>(ftello(fp));
+#endif
+    }
+
+    struct FileCloser
+    {
+        void operator()(FILE* fp) const { fclose(fp); }
+    };
+    typedef std::unique_ptr<FILE, FileCloser> FilePtr;
+}
+
+/*
+A tone plus gaussian noise on every channel, at amplitude (a fraction of full scale; the noise is 10 dB below).
+The samples come from a precomputed table per channel that repeats seamlessly, so producing them costs
+about as much as a memcpy and the source is never the bottleneck of a benchmark.
+
+Example:
+    SyntheticSource<std::complex<short>> src(50e6, 2, 2000, false); // as fast as the recorder can take it
+*/
+template <typename samp_type>
+class SyntheticSource : public EmulatedSource
+{
+public:
+    static const size_t TABLE = 1 << 16;
+
+    SyntheticSource(double rate, size_t numChannels, size_t packetSamples, bool paced,
+                    const SourceFaults& faults = SourceFaults(), double amplitude = 0.3)
+        : EmulatedSource(rate, numChannels, sizeof(samp_type), packetSamples, paced, faults),
+          m_tables(numChannels, std::vector<samp_type>(TABLE))
+    {
+        using namespace sample_source_detail;
+        const double pi = 3.14159265358979323846;
+        double scale = FullScale<typename Component<samp_type>::type>::value() * amplitude;
+        std::mt19937 rng(static_cast<unsigned>(faults.seed));
+        std::normal_distribution<double> noise(0, scale * std::sqrt(0.05)); // 10 dB below the tone, per component
+        for (size_t ch = 0; ch < numChannels; ch++){
+            size_t cycles = 1000 + 250 * ch; // a whole number of cycles, so the table wraps without a jump
+            for (size_t i = 0; i < TABLE; i++){
+                double phase = 2 * pi * cycles * i / TABLE;
+                m_tables[ch][i] = fromDouble<samp_type>(scale * std::cos(phase) + noise(rng), scale * std::sin(phase) + noise(rng));
+            }
+        }
+    }
+
+    std::string description() const override
+    {
+        char s[128];
+        snprintf(s, sizeof(s), "synthetic tone, %zu channels at %.3f MS/s%s", numChannels(), rate() / 1e6, paced() ? " (paced)" : "");
+        return s;
+    }
+
+protected:
+    void fill(const std::vector<void*>& buffs, unsigned long long position, size_t len) override
+    {
+        for (size_t ch = 0; ch < m_tables.size(); ch++){
+            samp_type* out = static_cast<samp_type*>(buffs[ch]);
+            size_t done = 0;
+            while (done < len){
+                size_t i = static_cast<size_t>((position + done) % TABLE);
+                size_t n = std::min(len - done, TABLE - i);
+                memcpy(out + done, &m_tables[ch][i], n * sizeof(samp_type));
+                done += n;
+            }
+        }
+    }
+
+private:
+    std::vector<std::vector<samp_type>> m_tables;
+};
+
+/*
+Replays raw sample files, one per channel (e.g. blocks written by the recorder), through the same recv emulation.
+The stream ends with the shortest file unless loop is set.
+*/
+template <typename samp_type>
+class FileReplaySource : public EmulatedSource
+{
+public:
+    FileReplaySource(const std::vector<std::string>& paths, double rate, size_t packetSamples, bool paced,
+                     bool loop = false, const SourceFaults& faults = SourceFaults())
+        : EmulatedSource(rate, paths.size(), sizeof(samp_type), packetSamples, paced, faults),
+          m_paths(paths), m_loop(loop)
+    {
+        // the files are owned as soon as they are open, so any that are open are closed if this throws
+        for (const std::string& path : paths){
+            FILE* fp = fopen(path.c_str(), "rb");
+            if (fp == NULL)
+                throw std::runtime_error("Could not open " + path);
+            m_files.emplace_back(fp);
+            sample_source_detail::seek(fp, 0, SEEK_END);
+            unsigned long long samples = static_cast<unsigned long long>(sample_source_detail::tell(fp)) / sizeof(samp_type);
+            m_fileSamples = m_files.size() == 1 ? samples : std::min(m_fileSamples, samples);
+        }
+        if (m_fileSamples == 0)
+            throw std::runtime_error("Nothing to replay");
+    }
+
+    FileReplaySource(const FileReplaySource&) = delete;
+    FileReplaySource& operator=(const FileReplaySource&) = delete;
+
+    long long start(unsigned long long numSamples) override
+    {
+        long long second = EmulatedSource::start(numSamples);
+        if (!m_loop)
+            limitSamples(m_fileSamples);
+        return second;
+    }
+
+    std::string description() const override
+    {
+        char s[512];
+        snprintf(s, sizeof(s), "replay of %s%s, %zu channels at %.3f MS/s%s", m_paths[0].c_str(), m_paths.size() > 1 ? ", ..." : "",
+                 numChannels(), rate() / 1e6, paced() ? " (paced)" : "");
+        return s;
+    }
+
+protected:
+    void fill(const std::vector<void*>& buffs, unsigned long long position, size_t len) override
+    {
+        for (size_t ch = 0; ch < m_files.size(); ch++){
+            samp_type* out = static_cast<samp_type*>(buffs[ch]);
+            size_t done = 0;
+            while (done < len){
+                unsigned long long i = (position + done) % m_fileSamples;
+                size_t n = static_cast<size_t>(std::min<unsigned long long>(len - done, m_fileSamples - i));
+                sample_source_detail::seek(m_files[ch].get(), static_cast<long long>(i * sizeof(samp_type)), SEEK_SET);
+                if (fread(out + done, sizeof(samp_type), n, m_files[ch].get()) != n)
+                    throw std::runtime_error("Could not read " + m_paths[ch]);
+                done += n;
+            }
+        }
+    }
+
+private:
+    std::vector<std::string> m_paths;
+    std::vector<sample_source_detail::FilePtr> m_files;
+    unsigned long long m_fileSamples = 0;
+    bool m_loop;
+};
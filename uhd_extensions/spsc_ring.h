@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Bounded lock-free queue for exactly one producer thread and one consumer thread.
+Each side only writes its own index, and caches the other side's, so a push or pop touches
+a shared cache line only when the cached index says the queue looks full or empty.
+Neither side ever blocks: tryPush fails when full and tryPop fails when empty.
+*/
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+        : m_capacity(roundUpPow2(capacity < 2 ? 2 : capacity)), m_mask(m_capacity - 1), m_items(m_capacity)
+    {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // producer only
+    bool tryPush(const T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache == m_capacity){
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache == m_capacity)
+                return false;
+        }
+        m_items[head & m_mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    bool tryPop(T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache){
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+                return false;
+        }
+        item = m_items[tail & m_mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // exact from either side when the other is idle, otherwise a snapshot
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    static size_t roundUpPow2(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::vector<T> m_items;
+
+    alignas(64) std::atomic<size_t> m_head{0}; // next slot to push, written by the producer
+    size_t m_tailCache = 0;                    // producer's copy of m_tail
+    alignas(64) std::atomic<size_t> m_tail{0}; // next slot to pop, written by the consumer
+    size_t m_headCache = 0;                    // consumer's copy of m_head
+};
+
+/*
+One producer publishing to several subscribers, each with its own SpscRing and consumer thread.
+publish() never waits: a subscriber whose queue is full misses the item, and the miss is counted,
+so a slow consumer (a monitor printing to a terminal, say) can fall behind without ever stalling the producer.
+A subscriber that must not miss anything needs a queue at least as deep as the items that can be outstanding.
+
+Idle consumers spin briefly and then sleep for idleSleep between polls, so publishing costs no system calls.
+
+Example:
+    SpscFanout<BlockDescriptor> blocks;
+    blocks.subscribe("writers", 16, [&](const BlockDescriptor& b){ ... });
+    blocks.start();
+    blocks.publish(desc);   // from the one producer thread
+    blocks.stop();          // drains every queue, then joins the consumers
+*/
+template <typename T>
+class SpscFanout
+{
+public:
+    typedef std::function<void(const T&)> Handler;
+
+    struct SubscriberStats
+    {
+        std::string name;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;    // items published while this subscriber's queue was full
+        size_t capacity = 0;
+    };
+
+    explicit SpscFanout(std::chrono::microseconds idleSleep = std::chrono::microseconds(200))
+        : m_idleSleep(idleSleep)
+    {
+    }
+
+    ~SpscFanout() { stop(); }
+
+    SpscFanout(const SpscFanout&) = delete;
+    SpscFanout& operator=(const SpscFanout&) = delete;
+
+    // only before start()
+    void subscribe(const std::string& name, size_t capacity, Handler handler)
+    {
+        m_subscribers.emplace_back(new Subscriber(name, capacity, std::move(handler)));
+    }
+
+    void start()
+    {
+        for (auto& s : m_subscribers){
+            Subscriber* sub = s.get();
+            sub->thread = std::thread([this, sub](){ consume(*sub); });
+        }
+        m_started = true;
+    }
+
+    // returns the number of subscribers that missed the item
+    size_t publish(const T& item)
+    {
+        size_t missed = 0;
+        for (auto& s : m_subscribers){
+            if (s->queue.tryPush(item))
+                s->delivered.store(s->delivered.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            else {
+                s->dropped.store(s->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                missed++;
+            }
+        }
+        return missed;
+    }
+
+    // every item already published is handled before this returns
+    void stop()
+    {
+        if (!m_started)
+            return;
+        m_stopping.store(true, std::memory_order_release);
+        for (auto& s : m_subscribers)
+            s->thread.join();
+        m_started = false;
+    }
+
+    // the consumer threads, e.g. to pin them
+    std::vector<std::thread*> threads()
+    {
+        std::vector<std::thread*> t;
+        for (auto& s : m_subscribers)
+            t.push_back(&s->thread);
+        return t;
+    }
+
+    std::vector<SubscriberStats> stats() const
+    {
+        std::vector<SubscriberStats> r;
+        for (auto& s : m_subscribers){
+            SubscriberStats st;
+            st.name = s->name;
+            st.delivered = s->delivered.load(std::memory_order_relaxed);
+            st.dropped = s->dropped.load(std::memory_order_relaxed);
+            st.capacity = s->queue.capacity();
+            r.push_back(st);
+        }
+        return r;
+    }
+
+    void printStats(const char* title) const
+    {
+        for (const SubscriberStats& s : stats())
+            printf("%s -> %s: %llu delivered, %llu dropped (queue of %zu)\n", title, s.name.c_str(),
+                   (unsigned long long)s.delivered, (unsigned long long)s.dropped, s.capacity);
+    }
+
+private:
+    struct Subscriber
+    {
+        Subscriber(const std::string& n, size_t capacity, Handler h)
+            : name(n), queue(capacity), handler(std::move(h)) {}
+
+        std::string name;
+        SpscRing<T> queue;
+        Handler handler;
+        std::thread thread;
+        std::atomic<uint64_t> delivered{0}; // written by the producer only
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    std::vector<std::unique_ptr<Subscriber>> m_subscribers;
+    std::chrono::microseconds m_idleSleep;
+    std::atomic<bool> m_stopping{false};
+    bool m_started = false;
+
+    void consume(Subscriber& sub)
+    {
+        const int SPINS = 64;
+        int idle = 0;
+        T item;
+        while (true)
+        {
+            if (sub.queue.tryPop(item)){
+                sub.handler(item);
+                idle = 0;
+                continue;
+            }
+            // stopping is only checked once the queue is seen empty, so nothing published is left behind
+            if (m_stopping.load(std::memory_order_acquire) && sub.queue.size() == 0)
+                return;
+            if (++idle < SPINS)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(m_idleSleep);
+        }
+    }
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+Pinning of threads to cores, and SCHED_FIFO, with the resulting placement read back for reporting.
+
+Core lists are written as in /sys, e.g. "2", "4-7" or "0,2,8-11", and "node:1" stands for every core of NUMA node 1.
+A single thread is pinned to the whole list; a group of threads (the writers, say) is spread over it,
+one core per thread, round-robin.
+
+Elsewhere than Linux nothing is applied, and every call reports that.
+*/
+namespace thread_placement
+{
+    // "0,2,8-11" -> {0, 2, 8, 9, 10, 11}
+    inline std::vector<int> parseCpuList(const std::string& list)
+    {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ',')){
+            item.erase(0, item.find_first_not_of(" \t\n"));
+            item.erase(item.find_last_not_of(" \t\n") + 1);
+            if (item.empty())
+                continue;
+            size_t dash = item.find('-');
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+            if (first < 0 || last < first)
+                throw std::runtime_error("Invalid core range " + item);
+            for (int c = first; c <= last; c++)
+                cpus.push_back(c);
+        }
+        return cpus;
+    }
+
+    // the cores of a NUMA node, from sysfs
+    inline std::vector<int> nodeCpus(int node)
+    {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!f || !std::getline(f, list))
+            throw std::runtime_error("No NUMA node " + std::to_string(node));
+        return parseCpuList(list);
+    }
+
+    // a core list, or node:<n>; empty for no pinning
+    inline std::vector<int> parseCpus(const std::string& spec)
+    {
+        if (spec.compare(0, 5, "node:") == 0)
+            return nodeCpus(std::stoi(spec.substr(5)));
+        return parseCpuList(spec);
+    }
+
+    // {0, 1, 2, 5} -> "0-2,5"
+    inline std::string formatCpuList(const std::vector<int>& cpus)
+    {
+        std::string s;
+        for (size_t i = 0; i < cpus.size(); ){
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+                j++;
+            if (!s.empty())
+                s += ",";
+            s += std::to_string(cpus[i]);
+            if (j > i)
+                s += "-" + std::to_string(cpus[j]);
+            i = j + 1;
+        }
+        return s;
+    }
+
+#ifdef __linux__
+    typedef pthread_t Handle;
+    inline Handle self() { return pthread_self(); }
+
+    // returns an error message, empty on success
+    inline std::string pin(Handle h, const std::vector<int>& cpus)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : cpus)
+            if (c < CPU_SETSIZE)
+                CPU_SET(c, &set);
+        int err = pthread_setaffinity_np(h, sizeof(set), &set);
+        return err == 0 ? "" : std::string("could not pin to cores ") + formatCpuList(cpus) + ": " + strerror(err);
+    }
+
+    // needs CAP_SYS_NICE or an rtprio limit (e.g. in /etc/security/limits.conf)
+    inline std::string setFifo(Handle h, int priority)
+    {
+        sched_param p;
+        memset(&p, 0, sizeof(p));
+        p.sched_priority = priority;
+        int err = pthread_setschedparam(h, SCHED_FIFO, &p);
+        return err == 0 ? "" : std::string("could not set SCHED_FIFO ") + std::to_string(priority) + ": " + strerror(err);
+    }
+
+    // e.g. "cores 2-3, SCHED_FIFO 50"
+    inline std::string describe(Handle h)
+    {
+        std::string s;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(h, sizeof(set), &set) == 0){
+            std::vector<int> cpus;
+            for (int c = 0; c < CPU_SETSIZE; c++)
+                if (CPU_ISSET(c, &set))
+                    cpus.push_back(c);
+            s = (cpus.size() == 1 ? "core " : "cores ") + formatCpuList(cpus);
+        }
+        int policy;
+        sched_param p;
+        if (pthread_getschedparam(h, &policy, &p) == 0 && policy != SCHED_OTHER)
+            s += std::string(", ") + (policy == SCHED_FIFO ? "SCHED_FIFO " : policy == SCHED_RR ? "SCHED_RR " : "policy ")
+                 + std::to_string(p.sched_priority);
+        return s;
+    }
+
+    // puts the calling thread's affinity and scheduling back as they were when this was constructed
+    class ScopedRestore
+    {
+    public:
+        ScopedRestore()
+        {
+            m_ok = pthread_getaffinity_np(pthread_self(), sizeof(m_set), &m_set) == 0
+                   && pthread_getschedparam(pthread_self(), &m_policy, &m_param) == 0;
+        }
+        ~ScopedRestore()
+        {
+            if (!m_ok)
+                return;
+            pthread_setschedparam(pthread_self(), m_policy, &m_param);
+            pthread_setaffinity_np(pthread_self(), sizeof(m_set), &m_set);
+        }
+        ScopedRestore(const ScopedRestore&) = delete;
+        ScopedRestore& operator=(const ScopedRestore&) = delete;
+
+    private:
+        bool m_ok;
+        cpu_set_t m_set;
+        int m_policy;
+        sched_param m_param;
+    };
+#else
+    typedef std::thread::native_handle_type Handle;
+    inline Handle self() { return Handle(); }
+    inline std::string pin(Handle, const std::vector<int>&) { return "thread pinning is only supported on Linux"; }
+    inline std::string setFifo(Handle, int) { return "SCHED_FIFO is only supported on Linux"; }
+    inline std::string describe(Handle) { return "unpinned"; }
+    class ScopedRestore {};
+#endif
+
+    // pins h (and sets SCHED_FIFO if rtPriority > 0), printing a warning for anything that fails
+    inline void apply(const char* role, Handle h, const std::vector<int>& cpus, int rtPriority = 0)
+    {
+        std::string err;
+        if (!cpus.empty() && !(err = pin(h, cpus)).empty())
+            fprintf(stderr, "======= Warning: %s %s\n", role, err.c_str());
+        if (rtPriority > 0 && !(err = setFifo(h, rtPriority)).empty())
+            fprintf(stderr, "======= Warning: %s %s\n", role, err.c_str());
+    }
+
+    // spreads a group of threads over cpus, one core each
+    inline void spread(const char* role, const std::vector<std::thread*>& threads, const std::vector<int>& cpus)
+    {
+        if (cpus.empty())
+            return;
+        for (size_t i = 0; i < threads.size(); i++)
+            apply(role, threads[i]->native_handle(), std::vector<int>(1, cpus[i % cpus.size()]));
+    }
+}
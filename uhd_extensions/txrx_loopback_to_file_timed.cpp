@@ -21,6 +21,8 @@
 #include <fstream>
 #include <iostream>
 
+#include "thread_placement.h"
+
 namespace po = boost::program_options;
 /***********************************************************************
  * Menu function declarations (at bottom)
@@ -102,7 +104,9 @@ void recv_to_file(uhd::usrp::multi_usrp::sptr usrp,
     size_t samps_per_buff,
     int num_requested_samples,
     double settling_time,
-    std::vector<size_t> rx_channel_nums)
+    std::vector<size_t> rx_channel_nums,
+    const std::vector<int>& rx_cpus,
+    int rt_priority)
 {
     int num_total_samps = 0;
     // create a receive streamer
@@ -134,6 +138,13 @@ void recv_to_file(uhd::usrp::multi_usrp::sptr usrp,
     double timeout =
         settling_time + 0.1f; // expected settling time + padding for first recv
 
+    // the receive loop runs on this thread, which is put back as it was afterwards
+    thread_placement::ScopedRestore restore_placement;
+    thread_placement::apply("receive thread", thread_placement::self(), rx_cpus, rt_priority);
+    std::cout << boost::format("Receive thread placement: %s")
+                     % thread_placement::describe(thread_placement::self())
+              << std::endl;
+
     // setup streaming
     uhd::stream_cmd_t stream_cmd((num_requested_samples == 0)
                                      ? uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS
@@ -207,7 +218,8 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
     double settling;
     
     // user variables
-    std::string folder;
+    std::string folder, rx_cpus_spec;
+    int rt_priority;
 
     // setup the program options
     po::options_description desc("Allowed options");
@@ -240,6 +252,8 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         ("tx-int-n", "tune USRP TX with integer-N tuning")
         ("rx-int-n", "tune USRP RX with integer-N tuning")
         ("folder", po::value<std::string>(&folder), "folder to search for transmit files")
+        ("rx-cpus", po::value<std::string>(&rx_cpus_spec)->default_value(""), "cores for the receive thread, e.g. \"2\", \"2-3\" or \"node:0\" for every core of NUMA node 0")
+        ("rt-priority", po::value<int>(&rt_priority)->default_value(0), "SCHED_FIFO priority for the receive thread (1-99, needs CAP_SYS_NICE or an rtprio limit), 0 for none")
     ;
     // clang-format on
     po::variables_map vm;
@@ -252,6 +266,9 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         return ~0;
     }
 
+    // checked before any device is made
+    const std::vector<int> rx_cpus = thread_placement::parseCpus(rx_cpus_spec);
+
     // create a usrp device (need to make two usrps? just one with tx_stream and rx_stream right? unless using 2 separate usrps..)
     std::cout << std::endl;
     std::cout << boost::format("Creating the transmit usrp device with: %s...") % tx_args
@@ -528,13 +545,13 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
     // recv to file
     if (type == "double")
         recv_to_file<std::complex<double>>(
-            rx_usrp, "fc64", otw, file, spb, total_num_samps, settling, rx_channel_nums);
+            rx_usrp, "fc64", otw, file, spb, total_num_samps, settling, rx_channel_nums, rx_cpus, rt_priority);
     else if (type == "float")
         recv_to_file<std::complex<float>>(
-            rx_usrp, "fc32", otw, file, spb, total_num_samps, settling, rx_channel_nums);
+            rx_usrp, "fc32", otw, file, spb, total_num_samps, settling, rx_channel_nums, rx_cpus, rt_priority);
     else if (type == "short")
         recv_to_file<std::complex<short>>(
-            rx_usrp, "sc16", otw, file, spb, total_num_samps, settling, rx_channel_nums);
+            rx_usrp, "sc16", otw, file, spb, total_num_samps, settling, rx_channel_nums, rx_cpus, rt_priority);
     else {
         // clean up transmit worker
         stop_signal_called = true;
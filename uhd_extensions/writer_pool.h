@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct WriterPoolStats
+{
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    size_t queueHighWater = 0;         // most jobs ever waiting at once
+    uint64_t queueFullStalls = 0;      // submits which had to wait for space in the queue
+    double queueFullWaitSeconds = 0;
+    uint64_t bufferStalls = 0;         // times the receiver had to wait for a buffer to come back from the writers
+    double bufferWaitSeconds = 0;
+};
+
+/*
+Fixed set of writer threads fed by a bounded queue.
+submit() blocks while the queue is full, so a slow disk pushes back on the caller
+instead of piling up threads; every such wait is counted in stats().
+Queued jobs are finished before the destructor returns.
+*/
+class WriterPool
+{
+public:
+    WriterPool(size_t numThreads, size_t queueCapacity)
+        : m_capacity(queueCapacity > 0 ? queueCapacity : 1)
+    {
+        for (size_t i = 0; i < numThreads; i++)
+            m_threads.emplace_back([this](){ run(); });
+    }
+
+    ~WriterPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_notEmpty.notify_all();
+        for (auto& t : m_threads)
+            t.join();
+    }
+
+    WriterPool(const WriterPool&) = delete;
+    WriterPool& operator=(const WriterPool&) = delete;
+
+    void submit(std::function<void()> job)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_capacity){
+            auto t1 = std::chrono::steady_clock::now();
+            m_notFull.wait(lock, [this](){ return m_queue.size() < m_capacity; });
+            m_stats.queueFullStalls++;
+            m_stats.queueFullWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+        }
+        m_queue.push_back(std::move(job));
+        m_stats.submitted++;
+        if (m_queue.size() > m_stats.queueHighWater)
+            m_stats.queueHighWater = m_queue.size();
+        lock.unlock();
+        m_notEmpty.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this](){ return m_stats.completed == m_stats.submitted; });
+    }
+
+    // for the caller to record time spent waiting on buffers held by the writers
+    void noteBufferStall(double seconds)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.bufferStalls++;
+        m_stats.bufferWaitSeconds += seconds;
+    }
+
+    // the writer threads, e.g. to pin them
+    std::vector<std::thread*> threads()
+    {
+        std::vector<std::thread*> t;
+        for (auto& th : m_threads)
+            t.push_back(&th);
+        return t;
+    }
+
+    WriterPoolStats stats()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    void printStats()
+    {
+        WriterPoolStats s = stats();
+        printf("Writer pool: %zu threads, %llu/%llu jobs done, queue high water %zu/%zu\n",
+               m_threads.size(), (unsigned long long)s.completed, (unsigned long long)s.submitted,
+               s.queueHighWater, m_capacity);
+        printf("  queue full %llu times (%.3f s waiting), buffer not yet written %llu times (%.3f s waiting)\n",
+               (unsigned long long)s.queueFullStalls, s.queueFullWaitSeconds,
+               (unsigned long long)s.bufferStalls, s.bufferWaitSeconds);
+    }
+
+private:
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_queue;
+    size_t m_capacity;
+    bool m_stopping = false;
+    WriterPoolStats m_stats;
+
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::condition_variable m_idle;
+
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_notEmpty.wait(lock, [this](){ return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty())
+                    return; // only once stopping, so everything queued has been run
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_notFull.notify_one();
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stats.completed++;
+            }
+            m_idle.notify_all();
+        }
+    }
+};
+
+/*
+Tracks the writers still using one buffer.
+The receiver hold()s it for each writer it hands the buffer to, each writer release()s it when done,
+and the receiver wait()s on it before filling the buffer again, so a stalled disk can never have
+its data overwritten underneath it.
+*/
+class BufferReturn
+{
+public:
+    void hold(int writers)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_holders += writers;
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_holders--;
+        }
+        m_returned.notify_all();
+    }
+
+    // returns the time spent waiting, which is 0 if the buffer was already back
+    double wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_holders == 0)
+            return 0;
+        auto t1 = std::chrono::steady_clock::now();
+        m_returned.wait(lock, [this](){ return m_holders == 0; });
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+    }
+
+private:
+    int m_holders = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_returned;
+};
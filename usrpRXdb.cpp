@@ -4,9 +4,252 @@ usrpRXdb::usrpRXdb(const char *in_filename, int in_flags, const char *zVfs)
 	: sq3db(in_filename, in_flags, zVfs)
 {
 	std::cout << "usrpRXdb ctor." << std::endl;
+	createSchema(in_flags);
+}
+
+usrpRXdb::usrpRXdb(const char *in_filename, const sq3profile &profile, int in_flags, const char *zVfs)
+	: sq3db(in_filename, profile, in_flags, zVfs)
+{
+	std::cout << "usrpRXdb ctor." << std::endl;
+	if (!profile.queryOnly)
+		createSchema(in_flags);
+}
+
+void usrpRXdb::createSchema(int in_flags)
+{
+	// no schema changes on read-only databases
+	if (in_flags & SQLITE_OPEN_READWRITE)
+	{
+		exec("create table if not exists blocks("
+			"id integer primary key, channel integer not null, second integer not null, "
+			"rate real, freq real, gain real, bytes integer not null, "
+			"max_mag real, mean_power real, saturated integer not null default 0, "
+			"unique(channel, second));");
+		exec("create table if not exists block_data(id integer primary key, data blob);");
+
+		// databases from before the summary columns existed
+		const char *summaryColumns[][2] = {
+			{"max_mag", "real"}, {"mean_power", "real"}, {"saturated", "integer not null default 0"}
+		};
+		std::vector<std::string> existing = getColumnNames("blocks");
+		for (auto &col : summaryColumns){
+			if (std::find(existing.begin(), existing.end(), col[0]) == existing.end())
+				exec(std::string("alter table blocks add column ") + col[0] + " " + col[1] + ";");
+		}
+
+		// covering index for queryBlocks (id is implicitly included as the rowid)
+		exec("create index if not exists blocks_summary on blocks(channel, second, max_mag, mean_power, saturated, bytes);");
+	}
+}
+
+long long usrpRXdb::reserveBlock(int channel, long long second, double rate, double freq, double gain, int bytes)
+{
+	bool ownsTransaction = !inTransaction();
+	if (ownsTransaction)
+		beginTransaction();
+
+	try{
+		sqlite3_stmt *stmt = cachedStatement("insert into blocks(channel, second, rate, freq, gain, bytes) values(?,?,?,?,?,?);");
+		bindAll(stmt, channel, second, rate, freq, gain, bytes);
+		stepReset(stmt);
+		long long id = sqlite3_last_insert_rowid(handle());
+
+		// zeroblob only reserves the space; the samples are written in place afterwards
+		stmt = cachedStatement("insert into block_data(id, data) values(?, zeroblob(?));");
+		bindAll(stmt, id, bytes);
+		stepReset(stmt);
+		addRowCount("blocks", 1);
+
+		if (ownsTransaction)
+			endTransaction();
+		return id;
+	}
+	catch (int err){
+		if (ownsTransaction)
+			exec("ROLLBACK;");
+		throw err;
+	}
+}
+
+void usrpRXdb::writeBlockData(long long id, const void *data, int bytes, int offset)
+{
+	sqlite3_blob *blob = nullptr;
+	int err = sqlite3_blob_open(handle(), "main", "block_data", "data", id, 1, &blob);
+	if (err == SQLITE_OK)
+	{
+		err = sqlite3_blob_write(blob, data, bytes, offset);
+	}
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d writing block %lld : %s \n", err, id, sqlite3_errmsg(handle()));
+		sqlite3_blob_close(blob);
+		throw err;
+	}
+	sqlite3_blob_close(blob);
+}
+
+long long usrpRXdb::writeBlock(int channel, long long second, double rate, double freq, double gain, const void *data, int bytes)
+{
+	bool ownsTransaction = !inTransaction();
+	if (ownsTransaction)
+		beginTransaction();
+
+	try{
+		long long id = reserveBlock(channel, second, rate, freq, gain, bytes);
+		writeBlockData(id, data, bytes);
+		if (ownsTransaction)
+			endTransaction();
+		return id;
+	}
+	catch (int err){
+		if (ownsTransaction)
+			exec("ROLLBACK;");
+		throw err;
+	}
+}
+
+bool usrpRXdb::deleteBlock(int channel, long long second)
+{
+	usrpBlockInfo info;
+	if (!getBlockInfo(channel, second, info))
+		return false;
+
+	bool ownsTransaction = !inTransaction();
+	if (ownsTransaction)
+		beginTransaction();
+
+	try{
+		sqlite3_stmt *stmt = cachedStatement("delete from block_data where id = ?;");
+		bindAll(stmt, info.id);
+		stepReset(stmt);
+		stmt = cachedStatement("delete from blocks where id = ?;");
+		bindAll(stmt, info.id);
+		stepReset(stmt);
+		addRowCount("blocks", -1);
+
+		if (ownsTransaction)
+			endTransaction();
+		return true;
+	}
+	catch (int err){
+		if (ownsTransaction)
+			exec("ROLLBACK;");
+		throw err;
+	}
+}
+
+bool usrpRXdb::getBlockInfo(int channel, long long second, usrpBlockInfo &info)
+{
+	sqlite3_stmt *stmt = cachedStatement("select id, rate, freq, gain, bytes from blocks where channel = ? and second = ?;");
+	bindAll(stmt, channel, second);
+
+	bool found = false;
+	int err = sqlite3_step(stmt);
+	if (err == SQLITE_ROW)
+	{
+		found = true;
+		info.channel = channel;
+		info.second = second;
+		sq3read(stmt, 0, info.id);
+		sq3read(stmt, 1, info.rate);
+		sq3read(stmt, 2, info.freq);
+		sq3read(stmt, 3, info.gain);
+		sq3read(stmt, 4, info.bytes);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	if (err != SQLITE_ROW && err != SQLITE_DONE)
+	{
+		printf("Error %d looking up block (%d, %lld) : %s \n", err, channel, second, sqlite3_errmsg(handle()));
+		throw err;
+	}
+	return found;
+}
+
+void usrpRXdb::readBlockData(long long id, void *out, int bytes, int offset)
+{
+	sqlite3_blob *blob = nullptr;
+	int err = sqlite3_blob_open(handle(), "main", "block_data", "data", id, 0, &blob);
+	if (err == SQLITE_OK)
+	{
+		err = sqlite3_blob_read(blob, out, bytes, offset);
+	}
+	if (err != SQLITE_OK)
+	{
+		printf("Error %d reading block %lld : %s \n", err, id, sqlite3_errmsg(handle()));
+		sqlite3_blob_close(blob);
+		throw err;
+	}
+	sqlite3_blob_close(blob);
+}
+
+int usrpRXdb::readBlock(int channel, long long second, void *out, int maxBytes, int offset)
+{
+	usrpBlockInfo info;
+	if (!getBlockInfo(channel, second, info))
+		return -1;
+
+	long long remaining = info.bytes - offset;
+	int bytes = remaining < maxBytes ? (int)(remaining > 0 ? remaining : 0) : maxBytes;
+	if (bytes > 0)
+		readBlockData(info.id, out, bytes, offset);
+	return bytes;
+}
+
+void usrpRXdb::setBlockSummary(long long id, double maxMag, double meanPower, bool saturated)
+{
+	sqlite3_stmt *stmt = cachedStatement("update blocks set max_mag = ?, mean_power = ?, saturated = ? where id = ?;");
+	bindAll(stmt, maxMag, meanPower, saturated ? 1 : 0, id);
+	stepReset(stmt);
+}
+
+size_t usrpRXdb::queryBlocks(int channel, long long firstSecond, long long lastSecond, std::vector<usrpBlockSummary> &out,
+	double minMaxMag, bool saturatedOnly)
+{
+	// null comparisons are false, so a threshold of -1 can't stand in for 'no threshold' with unsummarised blocks
+	sqlite3_stmt *stmt = cachedStatement(
+		"select id, second, bytes, max_mag, mean_power, saturated from blocks "
+		"where channel = ?1 and second between ?2 and ?3 and (?4 < 0 or max_mag >= ?4) and saturated >= ?5 "
+		"order by second;");
+	bindAll(stmt, channel, firstSecond, lastSecond, minMaxMag, saturatedOnly ? 1 : 0);
+
+	size_t n = 0;
+	int err;
+	while ((err = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		usrpBlockSummary b;
+		b.channel = channel;
+		sq3read(stmt, 0, b.id);
+		sq3read(stmt, 1, b.second);
+		sq3read(stmt, 2, b.bytes);
+		b.summarised = sqlite3_column_type(stmt, 3) != SQLITE_NULL;
+		if (b.summarised)
+		{
+			sq3read(stmt, 3, b.maxMag);
+			sq3read(stmt, 4, b.meanPower);
+		}
+		else
+		{
+			b.maxMag = std::numeric_limits<double>::quiet_NaN();
+			b.meanPower = std::numeric_limits<double>::quiet_NaN();
+		}
+		b.saturated = sqlite3_column_int(stmt, 5) != 0;
+		out.push_back(b);
+		n++;
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	if (err != SQLITE_DONE)
+	{
+		printf("Error %d querying blocks of channel %d : %s \n", err, channel, sqlite3_errmsg(handle()));
+		throw err;
+	}
+	return n;
 }
 
 usrpRXdb::~usrpRXdb()
 {
 	std::cout << "usrpRXdb dtor." << std::endl;
-}
\ No newline at end of file
+}
@@ -1,9 +1,78 @@
+#pragma once
+
 #include "sql3ext.h"
+#include <limits>
+
+// metadata of one stored capture block (one channel, one second)
+struct usrpBlockInfo
+{
+	long long id;
+	int channel;
+	long long second;
+	double rate;
+	double freq;
+	double gain;
+	long long bytes;
+};
 
+// per-block summary, enough to triage captures without reading their samples
+struct usrpBlockSummary
+{
+	long long id;
+	int channel;
+	long long second;
+	long long bytes;
+	bool summarised;  // false until setBlockSummary() is called, and then the fields below are unknown
+	double maxMag;    // largest sample magnitude (NaN if unknown)
+	double meanPower; // mean of |x|^2 (NaN if unknown)
+	bool saturated;   // any sample at the ADC's full scale (false if unknown)
+};
+
+/*
+Stores raw IQ capture blocks as BLOBs, one row per channel per second.
+Metadata lives in 'blocks' (unique on channel, second) and the samples in 'block_data', sharing the same id,
+so scanning metadata never touches the sample pages.
+Sample data is streamed with sqlite3_blob_write/read, so it is never staged in a second buffer.
+Blocks can carry a summary (setBlockSummary) which is kept in a covering index on (channel, second, ...),
+so range queries like "channel 1, seconds A to B, max magnitude above T" are answered from the index alone.
+The summary columns stay NULL until then, so an unscanned block reads as unknown rather than as silent.
+Note that SQLite limits a single blob to SQLITE_MAX_LENGTH (1e9 bytes by default).
+*/
 class usrpRXdb : public sq3db
 {
 public:
 	usrpRXdb(const char *in_filename, int in_flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, const char *zVfs = nullptr);
+	usrpRXdb(const char *in_filename, const sq3profile &profile, int in_flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, const char *zVfs = nullptr);
 	~usrpRXdb();
 
-};
\ No newline at end of file
+	// writes a whole block in one transaction; throws if the (channel, second) block already exists
+	long long writeBlock(int channel, long long second, double rate, double freq, double gain, const void *data, int bytes);
+
+	// for writing a block in pieces: reserve it, then write the pieces at their offsets
+	long long reserveBlock(int channel, long long second, double rate, double freq, double gain, int bytes);
+	void writeBlockData(long long id, const void *data, int bytes, int offset = 0);
+
+	// removes a block and its samples, returning false if no such block exists
+	bool deleteBlock(int channel, long long second);
+
+	// returns false if no such block exists
+	bool getBlockInfo(int channel, long long second, usrpBlockInfo &info);
+
+	// reads up to maxBytes from offset into out, returning the number of bytes read, or -1 if no such block exists
+	int readBlock(int channel, long long second, void *out, int maxBytes, int offset = 0);
+	void readBlockData(long long id, void *out, int bytes, int offset = 0);
+
+	// usually called once the block's samples have been scanned
+	void setBlockSummary(long long id, double maxMag, double meanPower, bool saturated);
+
+	/*
+	Appends the blocks of a channel within [firstSecond, lastSecond] whose max magnitude is at least minMaxMag, in order of second,
+	and returns the number appended. Blocks without a summary are only included when minMaxMag is not given.
+	*/
+	size_t queryBlocks(int channel, long long firstSecond, long long lastSecond, std::vector<usrpBlockSummary> &out,
+		double minMaxMag = -1.0, bool saturatedOnly = false);
+
+private:
+	void createSchema(int in_flags);
+
+};
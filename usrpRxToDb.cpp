@@ -1,6 +1,8 @@
 #include <iostream>
 // #include "sql3ext.h"
 #include "usrpRXdb.h"
+#include "sq3async.h"
+#include <complex>
 
 
 // #include <uhd/types/tune_request.hpp>
@@ -63,12 +65,95 @@ int main()
 	// count rows
 	std::cout << "Row count = " << usrpdb.getRowCount(std::string("t")) << std::endl;
 	
+	// keep the count (and a summary of c2) maintained, so later counts don't scan the table
+	usrpdb.trackRowCount("t");
+	usrpdb.trackColumnSummary("t", "c2");
+	
 	// add some rows
 	usrpdb.exec(std::string("insert into t values(1, 1.0)"));
 	usrpdb.exec(std::string("insert into t values(2, 2.0)"));
 	
 	// count again
 	std::cout << "Row count after adding 2 rows = " << usrpdb.getRowCount(std::string("t")) << std::endl;
+	
+	// bulk insert through a cached prepared statement, committing every 1000 rows
+	std::vector<std::tuple<int, double>> rows;
+	for (int i = 0; i < 10000; i++){
+		rows.push_back(std::make_tuple(i, i * 0.5));
+	}
+	usrpdb.insertRows("t", rows, 1000);
+	
+	// or stream rows in as they arrive
+	{
+		sq3inserter<int, double> ins(usrpdb, "t", 1000);
+		for (int i = 0; i < 2500; i++){
+			ins.insert(i, i * 0.25);
+		}
+	} // remaining rows are committed here
+	
+	std::cout << "Row count after bulk inserts = " << usrpdb.getRowCount(std::string("t")) << std::endl;
+	sq3summary c2summary;
+	if (usrpdb.getColumnSummary("t", "c2", c2summary)){
+		printf("c2 : %lld values, min %f, max %f, mean %f\n", c2summary.rows, c2summary.min, c2summary.max,
+			c2summary.rows > 0 ? c2summary.total / c2summary.rows : 0.0);
+	}
+	
+	// read typed columns back
+	std::vector<int> c1;
+	std::vector<double> c2;
+	c1.reserve(12502);
+	c2.reserve(12502);
+	size_t numRead = usrpdb.select("select c1, c2 from t", c1, c2);
+	std::cout << "Read " << numRead << " rows, last = (" << c1.back() << ", " << c2.back() << ")" << std::endl;
+	
+	// or page through them into fixed buffers
+	sq3cursor<int, double> cur(usrpdb, "select c1, c2 from t where c1 >= ?");
+	cur.bindParams(9000);
+	int pageC1[256];
+	double pageC2[256];
+	size_t numPaged = 0, n;
+	while ((n = cur.fetch(256, pageC1, pageC2)) > 0){
+		numPaged += n;
+	}
+	std::cout << "Paged through " << numPaged << " rows" << std::endl;
+	
+	// store one second of samples per channel as a blob, then read one back
+	// (blocks are unique per channel and second, so clear the ones left by a previous run first)
+	std::vector<std::complex<short>> block(1000000);
+	try{
+		for (int ch = 0; ch < 2; ch++){
+			usrpdb.deleteBlock(ch, 1600000000);
+			usrpdb.writeBlock(ch, 1600000000, 1e6, 1.5e9, 30.0, block.data(), (int)(block.size() * sizeof(block[0])));
+		}
+		int bytesRead = usrpdb.readBlock(1, 1600000000, block.data(), (int)(block.size() * sizeof(block[0])));
+		std::cout << "Read back " << bytesRead << " bytes from channel 1" << std::endl;
+		
+		// summarise the blocks, then triage by time range and magnitude without touching the samples
+		usrpBlockInfo info;
+		if (usrpdb.getBlockInfo(1, 1600000000, info)){
+			usrpdb.setBlockSummary(info.id, 12000.0, 1.0e6, false);
+		}
+		std::vector<usrpBlockSummary> hits;
+		usrpdb.queryBlocks(1, 1600000000, 1600000060, hits, 10000.0);
+		std::cout << "Blocks above threshold on channel 1 = " << hits.size() << std::endl;
+	}
+	catch(int err){
+		std::cout << "Error caught : " << err << std::endl;
+	}
+
+	// hand inserts to a dedicated writer thread, committed together every 100ms
+	{
+		sq3async<usrpRXdb> asyncdb(std::chrono::milliseconds(100), "usrpdb_async.db");
+		asyncdb.post([](usrpRXdb &db){ db.exec("create table if not exists detections(second int, channel int, power real)"); });
+		for (int i = 0; i < 1000; i++){
+			asyncdb.insert("detections", (long long)(1600000000 + i), 0, i * 0.1);
+		}
+		std::future<int> count = asyncdb.query([](usrpRXdb &db){
+			std::string tablename("detections");
+			return db.getRowCount(tablename);
+		});
+		std::cout << "Async row count = " << count.get() << std::endl;
+	} // anything still queued is committed before the writer thread exits
 
 	return 0;
 }
\ No newline at end of file